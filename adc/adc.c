@@ -7,7 +7,10 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include "../profile/profile.h"
+#include "../isr/snap.h"
 
+/* Written by the ISR, read through snap_u16() */
 static volatile uint16_t adc;
 
 void adc0_init(void)
@@ -34,13 +37,13 @@ void adc0_init(void)
 
 uint16_t adc0_get_val(void)
 {
-        return adc;
+        return snap_u16(&adc);
 }
 
 uint16_t adc0_get_val_percentage(void)
 {
         uint32_t percentage;
-        percentage = ((uint32_t)adc * 100) / 1023;
+        percentage = ((uint32_t)adc0_get_val() * 100) / 1023;
         /* Error correction, should not return more than 100 */
         if (percentage > 100) {
                 percentage = 100;
@@ -54,9 +57,11 @@ uint16_t adc0_get_val_percentage(void)
  */
 ISR(ADC_vect)
 {
+        PROFILE_ENTER();
         uint8_t adc_l, adc_h;
 
         adc_l = 0xB0 & ADCL;
         adc_h = ADCH;
         adc = (uint16_t)(adc_h << 2) | (uint16_t)(adc_l >> 6);
+        PROFILE_EXIT(PROFILE_ADC);
 }
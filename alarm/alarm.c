@@ -0,0 +1,240 @@
+/*
+ * alarm.c
+ *
+ * Created: 2016-05-25
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <string.h>
+#include "../common.h"
+#include "../rtc/rtc.h"
+#include "alarm.h"
+
+#define ALARM_NONE              (uint8_t)0xFF
+
+/* RTC RAM record: expiry (little endian) and an inverted XOR check byte,
+ * so cleared RAM and torn writes read back as "no alarm". ALARM_MAX records
+ * fill the RTC_RAM_ALARM area.
+ */
+#define ALARM_REC_SIZE          5
+
+struct alarm {
+        uint32_t expires;
+        uint32_t period;        /* 0 for one-shot alarms */
+        uint32_t phase;
+        alarm_handler_t handler;
+        uint8_t armed;
+        uint8_t slot;
+        uint8_t next;           /* Next alarm id in the slot, or ALARM_NONE */
+};
+
+static struct alarm alarms[ALARM_MAX];
+static uint8_t alarm_wheel[ALARM_WHEEL_SLOTS];
+/* Expiries found in RTC RAM at boot (kept up to date), 0 for none */
+static uint32_t alarm_saved[ALARM_MAX];
+/* Last second handled by alarm_tick() */
+static uint32_t alarm_now;
+
+static uint32_t alarm_rec_decode(const uint8_t *rec)
+{
+        uint8_t check = ~(rec[0] ^ rec[1] ^ rec[2] ^ rec[3]);
+
+        if (check != rec[4])
+                return 0;
+        return (uint32_t)rec[0] | (uint32_t)rec[1] << 8 |
+                        (uint32_t)rec[2] << 16 | (uint32_t)rec[3] << 24;
+}
+
+static void alarm_save(uint8_t id, uint32_t expires)
+{
+        uint8_t rec[ALARM_REC_SIZE];
+
+        if (alarm_saved[id] == expires)
+                return;
+        rec[0] = expires;
+        rec[1] = expires >> 8;
+        rec[2] = expires >> 16;
+        rec[3] = expires >> 24;
+        rec[4] = ~(rec[0] ^ rec[1] ^ rec[2] ^ rec[3]);
+        if (!rtc_set_ram(RTC_RAM_ALARM + id * ALARM_REC_SIZE, rec,
+                                                        ALARM_REC_SIZE))
+                alarm_saved[id] = expires;
+}
+
+/* Alarms already due go into the next slot */
+static void alarm_link(uint8_t id)
+{
+        struct alarm *a = &alarms[id];
+        uint32_t t = a->expires > alarm_now ? a->expires : alarm_now + 1;
+
+        a->slot = t & (ALARM_WHEEL_SLOTS - 1);
+        a->next = alarm_wheel[a->slot];
+        alarm_wheel[a->slot] = id;
+        a->armed = 1;
+}
+
+static void alarm_unlink(uint8_t id)
+{
+        uint8_t *link;
+
+        if (!alarms[id].armed)
+                return;
+        for (link = &alarm_wheel[alarms[id].slot]; *link != ALARM_NONE;
+                                                link = &alarms[*link].next) {
+                if (*link == id) {
+                        *link = alarms[id].next;
+                        break;
+                }
+        }
+        alarms[id].armed = 0;
+}
+
+static void alarm_arm(uint8_t id, uint32_t expires)
+{
+        alarm_unlink(id);
+        alarms[id].expires = expires;
+        alarm_link(id);
+        alarm_save(id, expires);
+}
+
+/* First time after now at the phase of a recurring alarm */
+static uint32_t alarm_next(const struct alarm *a, uint32_t now)
+{
+        uint32_t t = now - now % a->period + a->phase;
+
+        if (t <= now)
+                t += a->period;
+        return t;
+}
+
+static void alarm_fire(uint8_t id)
+{
+        struct alarm *a = &alarms[id];
+
+        /* Re-armed before the handler runs, which may then change it. A
+         * recurring alarm that missed several periods fires once.
+         */
+        if (a->period)
+                alarm_arm(id, alarm_next(a, alarm_now));
+        else
+                alarm_save(id, 0);
+        a->handler(id);
+}
+
+static void alarm_expire(uint8_t slot)
+{
+        uint8_t *link = &alarm_wheel[slot];
+        uint8_t due = 0;
+        uint8_t id;
+
+        while ((id = *link) != ALARM_NONE) {
+                if (alarms[id].expires <= alarm_now) {
+                        *link = alarms[id].next;
+                        alarms[id].armed = 0;
+                        due |= 1 << id;
+                } else {
+                        link = &alarms[id].next;
+                }
+        }
+        for (id = 0; id < ALARM_MAX; id++) {
+                if (due & (1 << id))
+                        alarm_fire(id);
+        }
+}
+
+static void alarm_rehash(void)
+{
+        uint8_t id;
+
+        memset(alarm_wheel, ALARM_NONE, sizeof(alarm_wheel));
+        for (id = 0; id < ALARM_MAX; id++) {
+                if (alarms[id].armed)
+                        alarm_link(id);
+        }
+}
+
+/* Reads back the alarms saved in RTC RAM, now is the current RTC time */
+int alarm_init(uint32_t now)
+{
+        uint8_t ram[ALARM_MAX * ALARM_REC_SIZE];
+        uint8_t id;
+
+        memset(alarms, 0, sizeof(alarms));
+        memset(alarm_wheel, ALARM_NONE, sizeof(alarm_wheel));
+        memset(alarm_saved, 0, sizeof(alarm_saved));
+        alarm_now = now;
+
+        if (rtc_get_ram(RTC_RAM_ALARM, ram, sizeof(ram)))
+                return -1;
+        for (id = 0; id < ALARM_MAX; id++)
+                alarm_saved[id] = alarm_rec_decode(&ram[id * ALARM_REC_SIZE]);
+        return 0;
+}
+
+/* One-shot alarm at an absolute time */
+int alarm_set(uint8_t id, uint32_t at, alarm_handler_t handler)
+{
+        if (id >= ALARM_MAX || !handler || !at)
+                return -1;
+        alarms[id].handler = handler;
+        alarms[id].period = 0;
+        alarm_arm(id, at);
+        return 0;
+}
+
+/* Re-arms the one-shot alarm saved before a reset, -1 if there is none */
+int alarm_resume(uint8_t id, alarm_handler_t handler)
+{
+        if (id >= ALARM_MAX || !alarm_saved[id])
+                return -1;
+        return alarm_set(id, alarm_saved[id], handler);
+}
+
+/* Recurring alarm at phase, phase + period, ... seconds since 2000. A saved
+ * expiry matching the schedule is kept, so a period missed during a reset
+ * fires on the next tick.
+ */
+int alarm_set_every(uint8_t id, uint32_t period, uint32_t phase,
+                                                alarm_handler_t handler)
+{
+        struct alarm *a;
+        uint32_t expires;
+
+        if (id >= ALARM_MAX || !handler || !period)
+                return -1;
+        a = &alarms[id];
+        a->handler = handler;
+        a->period = period;
+        a->phase = phase % period;
+
+        expires = alarm_saved[id];
+        if (!expires || expires % period != a->phase)
+                expires = alarm_next(a, alarm_now);
+        alarm_arm(id, expires);
+        return 0;
+}
+
+int alarm_cancel(uint8_t id)
+{
+        if (id >= ALARM_MAX)
+                return -1;
+        alarm_unlink(id);
+        alarm_save(id, 0);
+        return 0;
+}
+
+/* Called once per second with the current RTC time */
+void alarm_tick(uint32_t now)
+{
+        /* Clock set backwards or seconds missed, e.g. a long blocking
+         * task: re-slot everything, due alarms fire on this tick.
+         */
+        if (now < alarm_now || now - alarm_now > ALARM_WHEEL_SLOTS) {
+                alarm_now = now - 1;
+                alarm_rehash();
+        }
+        while (alarm_now != now) {
+                alarm_now++;
+                alarm_expire(alarm_now & (ALARM_WHEEL_SLOTS - 1));
+        }
+}
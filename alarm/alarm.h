@@ -0,0 +1,44 @@
+/*
+ * alarm.h
+ *
+ * Description: Software alarms keyed by RTC time, in seconds since
+ * 2000-01-01 (rtc_mktime()). Alarms are one-shot at an absolute time or
+ * recurring every period seconds at a phase, e.g. period 900 and phase 0
+ * fires every 15 minutes at :00, :15, :30 and :45.
+ *
+ * Armed alarms sit in a hashed timer wheel of one second slots, giving
+ * O(1) arming and per-second expiry. The next expiry of each alarm is kept
+ * in the RTC battery-backed RAM, so alarms that came due while the board
+ * was reset or unpowered fire once the alarm is set up again.
+ *
+ * Created: 2016-05-25
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef ALARM_H_
+#define ALARM_H_
+
+#include <stdint.h>
+
+/* Alarm ids 0..ALARM_MAX-1, each id has a 5 byte RTC RAM slot */
+#define ALARM_MAX               4
+/* Timer wheel slots, power of two */
+#define ALARM_WHEEL_SLOTS       16
+
+#define ALARM_MINUTE            60UL
+#define ALARM_HOUR              (60 * ALARM_MINUTE)
+#define ALARM_DAY               (24 * ALARM_HOUR)
+
+/* Called from alarm_tick() with the alarm id */
+typedef void (*alarm_handler_t)(uint8_t id);
+
+int alarm_init(uint32_t now);
+int alarm_set(uint8_t id, uint32_t at, alarm_handler_t handler);
+int alarm_resume(uint8_t id, alarm_handler_t handler);
+int alarm_set_every(uint8_t id, uint32_t period, uint32_t phase,
+                                                alarm_handler_t handler);
+int alarm_cancel(uint8_t id);
+void alarm_tick(uint32_t now);
+
+#endif /* ALARM_H_ */
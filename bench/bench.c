@@ -0,0 +1,380 @@
+/*
+ * bench.c
+ *
+ * Created: 2016-06-01
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "../common.h"
+#include "../clock/clock.h"
+#include "../i2c/i2c.h"
+#include "../i2c/soft/i2c_soft.h"
+#include "../rtc/rtc.h"
+#include "../rtc/ds1307.h"
+#include "../eeprom/eeprom.h"
+#include "../log/log.h"
+#include "../log/log_pack.h"
+#include "../uart/uart.h"
+#include "bench.h"
+
+#define BENCH_TICKS_US(t)       ((t) / (CLOCK_HZ / 1000000UL))
+/* Upper bound for the ACK polling of one write cycle */
+#define BENCH_MAX_POLLS         2000
+
+/* Records generated for the log packing test */
+#define BENCH_PACK_RECS         32
+
+/* ADC conversion time in clock ticks, 13 ADC clocks at F_CPU/128 */
+#define BENCH_ADC_TICKS         (13UL * 128 / CLOCK_PRESCALE)
+
+struct bench {
+        const char *name;       /* In flash */
+        uint16_t khz;
+        uint16_t bytes;         /* Per run, for the throughput column */
+        uint16_t runs;
+        uint32_t min;
+        uint32_t max;
+        uint32_t total;
+};
+
+static uint8_t bench_buf[EEPROM_PAGE_SIZE * BENCH_SCRATCH_PAGES];
+
+static void bench_begin(struct bench *b, const char *name, uint16_t khz,
+                                                        uint16_t bytes)
+{
+        memset(b, 0, sizeof(*b));
+        b->name = name;
+        b->khz = khz;
+        b->bytes = bytes;
+        b->min = 0xFFFFFFFF;
+}
+
+static void bench_add(struct bench *b, uint32_t ticks)
+{
+        b->runs++;
+        b->total += ticks;
+        if (ticks < b->min)
+                b->min = ticks;
+        if (ticks > b->max)
+                b->max = ticks;
+}
+
+/* Waits for the UART TX ring to empty, so its ISR does not skew the
+ * timing of the next measurement.
+ */
+static void bench_drain(void)
+{
+        while (uart0_tx_free() != UART_TX_LENGTH - 1)
+                ;
+}
+
+static void bench_print(struct bench *b)
+{
+        uint32_t avg = b->runs ? b->total / b->runs : 0;
+
+        if (!b->runs)
+                b->min = 0;
+        printf_P(PSTR("%-16S %4u %5u %8lu %8lu %8lu"), b->name, b->khz, b->runs,
+                        (unsigned long)BENCH_TICKS_US(b->min),
+                        (unsigned long)BENCH_TICKS_US(avg),
+                        (unsigned long)BENCH_TICKS_US(b->max));
+        if (b->bytes && avg)
+                printf_P(PSTR(" %8lu"), (unsigned long)((uint64_t)b->bytes *
+                                                        CLOCK_HZ / avg));
+        printf_P(PSTR("\n"));
+        bench_drain();
+}
+
+/* Polls the device until it ACKs, i.e. its write cycle is done */
+static int bench_wait_ready(uint8_t cli_addr)
+{
+        uint16_t polls;
+
+        for (polls = 0; polls < BENCH_MAX_POLLS; polls++) {
+                if (i2c_probe(cli_addr) == 0)
+                        return 0;
+        }
+        return -1;
+}
+
+static void bench_rtc(uint16_t khz)
+{
+        struct rtc_time time;
+        struct bench b;
+        uint32_t t;
+        uint8_t i;
+
+#ifdef I2C_SOFT_ADDR
+        /* Not affected by i2c_set_clk() on the bit-banged bus */
+        if (I2C_SOFT_ADDR == DS1307)
+                khz = I2C_SOFT_FREQ / 1000;
+#endif
+        bench_begin(&b, PSTR("rtc burst read"), khz, DS1307_NBR_REGS - 1);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                t = clock_now32();
+                if (rtc_get_time(&time))
+                        continue;
+                bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+}
+
+/* The byte and page rows read past the cache, with the address written.
+ * The seq row scans through the cold cache, the hit row reads a cached
+ * page.
+ */
+static void bench_eeprom_rd(uint16_t khz, uint16_t base)
+{
+        struct bench b;
+        uint32_t t;
+        uint8_t i;
+
+        bench_begin(&b, PSTR("eeprom rd byte"), khz, 1);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                eeprom_cache_invalidate();
+                t = clock_now32();
+                if (!eeprom_get_data_uncached(base + i, bench_buf, 1))
+                        bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+
+        bench_begin(&b, PSTR("eeprom rd page"), khz, EEPROM_PAGE_SIZE);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                eeprom_cache_invalidate();
+                t = clock_now32();
+                if (!eeprom_get_data_uncached(base, bench_buf,
+                                                        EEPROM_PAGE_SIZE))
+                        bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+
+        bench_begin(&b, PSTR("eeprom rd seq"), khz, sizeof(bench_buf));
+        for (i = 0; i < BENCH_RUNS; i++) {
+                eeprom_cache_invalidate();
+                t = clock_now32();
+                if (!eeprom_get_data(base, bench_buf, sizeof(bench_buf)))
+                        bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+
+        bench_begin(&b, PSTR("eeprom rd hit"), khz, EEPROM_PAGE_SIZE);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                t = clock_now32();
+                if (!eeprom_get_data(base, bench_buf, EEPROM_PAGE_SIZE))
+                        bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+}
+
+/* Writes are timed until the EEPROM ACKs again, write cycle included */
+static void bench_eeprom_wr(uint16_t khz, uint16_t base, uint8_t dev)
+{
+        struct bench b, cycle;
+        uint32_t t, t_stop;
+        uint8_t i;
+
+        memset(bench_buf, 0x5A, sizeof(bench_buf));
+
+        bench_begin(&b, PSTR("eeprom wr byte"), khz, 1);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                t = clock_now32();
+                if (!eeprom_set_data(base + i, bench_buf, 1) &&
+                    !bench_wait_ready(dev))
+                        bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+
+        bench_begin(&b, PSTR("eeprom wr page"), khz, EEPROM_PAGE_SIZE);
+        bench_begin(&cycle, PSTR("eeprom wr cycle"), khz, 0);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                t = clock_now32();
+                if (eeprom_set_data(base, bench_buf, EEPROM_PAGE_SIZE))
+                        continue;
+                t_stop = clock_now32();
+                if (bench_wait_ready(dev))
+                        continue;
+                bench_add(&b, clock_now32() - t);
+                bench_add(&cycle, clock_now32() - t_stop);
+        }
+        bench_print(&b);
+        bench_print(&cycle);
+
+        bench_begin(&b, PSTR("eeprom wr seq"), khz, sizeof(bench_buf));
+        for (i = 0; i < BENCH_RUNS; i++) {
+                t = clock_now32();
+                if (!eeprom_set_data(base, bench_buf, sizeof(bench_buf)) &&
+                    !bench_wait_ready(dev))
+                        bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+}
+
+/* The ADC ISR cost is the slow-down of a busy loop with the ISR enabled,
+ * divided by the number of conversions completed meanwhile.
+ */
+static void bench_adc(void)
+{
+        struct bench b;
+        volatile uint16_t n;
+        uint32_t t, t_off, t_on;
+        uint8_t i;
+
+        bench_begin(&b, PSTR("adc isr"), 0, 0);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                ADCSRA &= ~(1 << ADIE);
+                t = clock_now32();
+                for (n = 0; n < 10000; n++)
+                        ;
+                t_off = clock_now32() - t;
+                ADCSRA |= (1 << ADIE);
+                t = clock_now32();
+                for (n = 0; n < 10000; n++)
+                        ;
+                t_on = clock_now32() - t;
+                if (t_on > t_off)
+                        bench_add(&b, (t_on - t_off) * BENCH_ADC_TICKS / t_on);
+        }
+        bench_print(&b);
+}
+
+#ifdef I2C_SOFT_ADDR
+/* The bit-banged bus is run by the CPU, so its time per byte is the CPU
+ * cost. An 8 byte register read puts 11 bytes on the wire, both client
+ * addresses, the register address and the data.
+ */
+static void bench_soft(void)
+{
+        struct bench b;
+        uint32_t t;
+        uint8_t i;
+
+        bench_begin(&b, PSTR("soft cpu/byte"), I2C_SOFT_FREQ / 1000, 1);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                t = clock_now32();
+                if (!i2c_rd_addr_blk(I2C_SOFT_ADDR, 0, bench_buf, 8))
+                        bench_add(&b, (clock_now32() - t) / 11);
+        }
+        bench_print(&b);
+}
+#endif
+
+/* Packs as many records of a simulated 1 Hz sampling as fit into a page,
+ * millisecond jitter and a noisy value. The B/s column is of unpacked
+ * records.
+ */
+static void bench_log_pack(void)
+{
+        struct log_rec recs[BENCH_PACK_RECS];
+        struct bench b;
+        uint16_t val = 512;
+        uint8_t r = 1, n, i, bad;
+        uint8_t *page;
+        uint32_t t;
+
+        for (n = 0; n < BENCH_PACK_RECS; n++) {
+                r = r * 109 + 89;
+                val += (r >> 5) - 3;
+                recs[n].sec = 43200 + n;
+                recs[n].ms = 250 + (r & 3);
+                recs[n].val = val & 0x3FF;
+        }
+        for (n = 1; n < BENCH_PACK_RECS; n++) {
+                if (log_pack_size(recs, n + 1) > EEPROM_PAGE_SIZE)
+                        break;
+        }
+
+        bench_begin(&b, PSTR("log pack"), 0, n * LOG_REC_SIZE);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                t = clock_now32();
+                if (log_pack(recs, n, bench_buf) > 0)
+                        bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+        bench_begin(&b, PSTR("log unpack"), 0, n * LOG_REC_SIZE);
+        for (i = 0; i < BENCH_RUNS; i++) {
+                t = clock_now32();
+                if (log_unpack(bench_buf, recs, BENCH_PACK_RECS) == n)
+                        bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+
+        /* Corrupt pages are rejected rather than decoded past their end:
+         * all ones with k = 0 escapes on every code, and a Rice parameter
+         * out of range.
+         */
+        page = &bench_buf[EEPROM_PAGE_SIZE];
+        memcpy(page, bench_buf, EEPROM_PAGE_SIZE);
+        page[1 + LOG_REC_SIZE] = 0x00;
+        page[2 + LOG_REC_SIZE] = 0x00;
+        memset(&page[LOG_PACK_HDR_SIZE], 0xFF,
+                                EEPROM_PAGE_SIZE - LOG_PACK_HDR_SIZE);
+        bad = log_unpack(page, recs, BENCH_PACK_RECS) != -1;
+        page[2 + LOG_REC_SIZE] = 0xFF;
+        memset(&page[LOG_PACK_HDR_SIZE], 0x00,
+                                EEPROM_PAGE_SIZE - LOG_PACK_HDR_SIZE);
+        bad |= log_unpack(page, recs, BENCH_PACK_RECS) != -1;
+        printf_P(PSTR("log unpack corrupt page: %S\n"),
+                                bad ? PSTR("FAIL") : PSTR("rejected"));
+
+        printf_P(PSTR("log pack: %u records/page, ratio %u.%02u, "
+                        "decoder RAM %u B\n"), n,
+                        n * LOG_REC_SIZE / EEPROM_PAGE_SIZE,
+                        n * LOG_REC_SIZE * 100 / EEPROM_PAGE_SIZE % 100,
+                        (unsigned int)(EEPROM_PAGE_SIZE +
+                                        sizeof(struct log_bits)));
+        bench_drain();
+}
+
+static void bench_uart(void)
+{
+        struct bench b;
+        uint32_t t;
+        uint8_t i, j;
+
+        bench_begin(&b, PSTR("uart tx"), 0, 64);
+        for (i = 0; i < 4; i++) {
+                t = clock_now32();
+                for (j = 0; j < 63; j++)
+                        uart0_transmit('.');
+                uart0_transmit('\n');
+                bench_drain();
+                bench_add(&b, clock_now32() - t);
+        }
+        bench_print(&b);
+}
+
+void bench_run(void)
+{
+        static const uint16_t khz[] = { 100, 400 };
+        uint16_t base;
+        uint8_t dev, i;
+
+        if (EEPROM_NBR_PAGES < BENCH_SCRATCH_PAGES) {
+                printf_P(PSTR("Benchmark: no EEPROM\n"));
+                return;
+        }
+        base = (EEPROM_NBR_PAGES - BENCH_SCRATCH_PAGES) * EEPROM_PAGE_SIZE;
+        dev = AT24C32 + (EEPROM_NBR_PAGES - 1) / EEPROM_DEV_PAGES;
+
+        printf_P(PSTR("\ntest              kHz  runs   min us   avg us"
+                        "   max us      B/s\n"));
+        bench_drain();
+        for (i = 0; i < sizeof(khz) / sizeof(khz[0]); i++) {
+                i2c_set_clk(F_CPU, khz[i] * 1000UL);
+                bench_rtc(khz[i]);
+                bench_eeprom_rd(khz[i], base);
+                bench_eeprom_wr(khz[i], base, dev);
+        }
+        i2c_set_clk(F_CPU, 100000UL);
+#ifdef I2C_SOFT_ADDR
+        bench_soft();
+#endif
+        bench_adc();
+        bench_log_pack();
+        bench_uart();
+        printf_P(PSTR("\n"));
+}
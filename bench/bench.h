@@ -0,0 +1,25 @@
+/*
+ * bench.h
+ *
+ * Description: On-target benchmark run at boot in APP_BENCHMARK mode. Times
+ * the RTC, EEPROM, ADC ISR, log packing (log/log_pack.h) and UART on the
+ * real parts with the Timer1 clock (clock/clock.h) and prints one table row
+ * per measurement. The log packing ratio and decoder RAM follow its rows.
+ *
+ * The EEPROM tests overwrite the last BENCH_SCRATCH_PAGES pages of the
+ * EEPROM address space, outside the log (log/log.h).
+ *
+ * Created: 2016-06-01
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#define BENCH_RUNS              16
+#define BENCH_SCRATCH_PAGES     4
+
+void bench_run(void);
+
+#endif /* BENCH_H_ */
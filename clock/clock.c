@@ -0,0 +1,103 @@
+/*
+ * clock.c
+ *
+ * Created: 2016-05-23
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "../common.h"
+#include "../profile/profile.h"
+#include "clock.h"
+
+/* Arming a compare closer than this could miss the match */
+#define CLOCK_AT_MIN            (int32_t)32
+
+/* Upper 16 bits of the 32-bit tick count */
+static volatile uint16_t clock_ovf;
+
+/* One-shot call of clock_at() */
+static uint32_t clock_at_tick;
+static void (*volatile clock_at_cb)(void);
+
+void clock_init(void)
+{
+        TCCR1A = 0x00;          /* Normal mode, free-running */
+        TCCR1B = (1 << CS11);   /* F_CPU/8 pre-scaling */
+        TCNT1 = 0;
+        clock_ovf = 0;
+        TIFR1 = (1 << TOV1);    /* Clear a pending overflow */
+        TIMSK1 |= (1 << TOIE1); /* Enable overflow IRQ */
+}
+
+/* With interrupts disabled. An overflow that is pending (not yet counted by
+ * the ISR) is accounted for unless TCNT1 was read before it wrapped.
+ */
+uint32_t clock_now32_isr(void)
+{
+        uint16_t ovf = clock_ovf;
+        uint16_t now = TCNT1;
+
+        if ((TIFR1 & (1 << TOV1)) && now < 0x8000)
+                ovf++;
+        return ((uint32_t)ovf << 16) | now;
+}
+
+uint32_t clock_now32(void)
+{
+        uint32_t now;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                now = clock_now32_isr();
+        }
+        return now;
+}
+
+/* Calls cb (interrupt context) once the clock reaches tick, which must be
+ * less than 2^31 ticks ahead. Replaces a pending call. Returns -1 if tick
+ * is too close (or passed) to arm the Timer1 compare, the caller goes
+ * ahead itself then.
+ */
+int clock_at(uint32_t tick, void (*cb)(void))
+{
+        int ret = 0;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                if ((int32_t)(tick - clock_now32_isr()) < CLOCK_AT_MIN) {
+                        ret = -1;
+                } else {
+                        clock_at_tick = tick;
+                        clock_at_cb = cb;
+                        OCR1A = (uint16_t)tick;
+                        TIFR1 = (1 << OCF1A);
+                        TIMSK1 |= (1 << OCIE1A);
+                }
+        }
+        return ret;
+}
+
+/* Matches once per Timer1 period, the call is due in the period of the
+ * target tick.
+ */
+ISR(TIMER1_COMPA_vect)
+{
+        PROFILE_ENTER();
+        void (*cb)(void);
+
+        if ((int32_t)(clock_now32_isr() - clock_at_tick) >= 0) {
+                TIMSK1 &= ~(1 << OCIE1A);
+                cb = clock_at_cb;
+                clock_at_cb = NULL;
+                if (cb)
+                        cb();
+        }
+        PROFILE_EXIT(PROFILE_TMR1);
+}
+
+ISR(TIMER1_OVF_vect)
+{
+        PROFILE_ENTER();
+        clock_ovf++;
+        PROFILE_EXIT(PROFILE_TMR1);
+}
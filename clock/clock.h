@@ -0,0 +1,50 @@
+/*
+ * clock.h
+ *
+ * Description: Free-running 16-bit Timer1 used as a high resolution time
+ * base for tracing and measurements, one tick is CLOCK_PRESCALE CPU
+ * cycles. Intervals are computed as (uint16_t)(end - start), i.e. they
+ * must be shorter than 65536 ticks (~32 ms). The overflow IRQ extends the
+ * counter to 32 bits (~35 min) for longer intervals. The OCR1A compare
+ * runs a one-shot callback at a given tick (clock_at()).
+ *
+ * Created: 2016-05-23
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <stdint.h>
+
+#define CLOCK_PRESCALE          8
+#define CLOCK_HZ                (F_CPU / CLOCK_PRESCALE)  /* 2 MHz */
+
+void clock_init(void);
+uint32_t clock_now32_isr(void);
+uint32_t clock_now32(void);
+int clock_at(uint32_t tick, void (*cb)(void));
+
+/* Current tick, from ISRs (or with interrupts disabled) */
+static inline uint16_t clock_now_isr(void)
+{
+        return TCNT1;
+}
+
+/* Current tick, the 16-bit TCNT1 read must not be split by an ISR that
+ * reads it as well (shared TEMP register).
+ */
+static inline uint16_t clock_now(void)
+{
+        uint16_t now;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                now = TCNT1;
+        }
+        return now;
+}
+
+#endif /* CLOCK_H_ */
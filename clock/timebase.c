@@ -0,0 +1,252 @@
+/*
+ * timebase.c
+ *
+ * Created: 2016-05-26
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <string.h>
+#include "../common.h"
+#include "../i2c/i2c.h"
+#include "../rtc/rtc.h"
+#include "../rtc/ds1307.h"
+#include "clock.h"
+#include "timebase.h"
+
+/* Clock ticks per Timer0 overflow (F_CPU/1024/256), the task period */
+#define TIMEBASE_TICK           (1024UL * 256 / CLOCK_PRESCALE)
+/* Window half-width around a predicted edge once calibrated */
+#define TIMEBASE_GUARD          (CLOCK_HZ / 500)                /* 2 ms */
+/* Reads of a capture window are this far apart */
+#define TIMEBASE_STEP           (CLOCK_HZ / 2000)               /* 0.5 ms */
+/* Largest read gap an edge is taken from, a longer one is a miss */
+#define TIMEBASE_MAX_GAP        (4 * TIMEBASE_STEP)
+/* Measured rates further off the nominal clock are rejected */
+#define TIMEBASE_MAX_DEV        (CLOCK_HZ / 100)                /* 1 % */
+
+/* Reference edge state */
+#define TB_REF_NONE             (uint8_t)0
+#define TB_REF_COARSE           (uint8_t)1      /* +/- half a task period */
+#define TB_REF_FINE             (uint8_t)2      /* +/- half an I2C read */
+
+/* tb_capture() return, the edge was between reads too far apart */
+#define TB_MISSED               1
+#define TB_POLLING              2
+
+static uint8_t tb_ref;
+static uint32_t tb_edge;        /* Clock tick of the reference edge */
+static uint32_t tb_epoch;       /* RTC seconds starting at tb_edge */
+static uint8_t tb_span;         /* Seconds from tb_edge to the next capture */
+static uint32_t tb_guard;
+static void (*tb_wake)(void);   /* Runs the task at the next window read */
+static uint8_t tb_poll;         /* Window open, tb_prev read the old second */
+static uint32_t tb_prev;
+
+/* Latest fine reference, kept for timestamps while re-synchronizing */
+static uint8_t tb_valid;
+static uint32_t tb_valid_edge;
+static uint32_t tb_valid_epoch;
+
+static uint8_t tb_rated;        /* tb_rate measured */
+static uint32_t tb_rate;        /* Clock ticks per RTC second */
+static uint32_t tb_scale;       /* Milliseconds per tick, Q32 */
+
+/* Coarse search state */
+static uint8_t tb_sec;
+static uint32_t tb_sec_tick;
+
+static void tb_set_rate(uint32_t rate)
+{
+        tb_rate = rate;
+        tb_scale = ((uint64_t)1000 << 32) / rate;
+}
+
+/* Seconds register (without CH) and the clock tick before the read */
+static int tb_read_sec(uint8_t *sec, uint32_t *tick)
+{
+        *tick = clock_now32();
+        if (i2c_rd_addr_byte(DS1307, DS1307_REG_SEC, sec))
+                return -1;
+        *sec = I2C_FIELD_GET(sec, DS1307_SEC);
+        return 0;
+}
+
+static void tb_coarse(void)
+{
+        tb_ref = TB_REF_NONE;
+        tb_sec = 0xFF;
+        tb_poll = 0;
+}
+
+/* wake (interrupt context) has to run timebase_task() */
+void timebase_init(void (*wake)(void))
+{
+        tb_wake = wake;
+        tb_valid = 0;
+        tb_rated = 0;
+        tb_set_rate(CLOCK_HZ);
+        tb_coarse();
+}
+
+/* Coarse search, the seconds register is read once per task run until it
+ * changes. The edge is between the last two reads.
+ */
+static void tb_search(void)
+{
+        struct rtc_time time;
+        uint32_t tick;
+        uint8_t sec;
+
+        if (tb_read_sec(&sec, &tick))
+                return;
+        if (tb_sec == 0xFF || sec == tb_sec) {
+                tb_sec = sec;
+                tb_sec_tick = tick;
+                return;
+        }
+        tb_sec = sec;
+        /* Date and time of the new second, retried if it already passed */
+        if (rtc_get_time(&time) || bin2bcd(time.sec) != sec) {
+                tb_sec = 0xFF;
+                return;
+        }
+        tb_edge = tick - (tick - tb_sec_tick) / 2;
+        tb_epoch = rtc_mktime(&time);
+        /* The RTC was set, drop the reference used for timestamps */
+        if (tb_valid && tb_epoch - tb_valid_epoch !=
+                        (tb_edge - tb_valid_edge + tb_rate / 2) / tb_rate)
+                tb_valid = 0;
+        tb_span = 1;
+        tb_guard = TIMEBASE_TICK;
+        tb_ref = TB_REF_COARSE;
+}
+
+/* Fine capture, one read of the seconds register per run in a window of
+ * +/- the guard around the predicted edge. The next read is a Timer1
+ * compare away, the other tasks run in between. Returns TB_POLLING while
+ * the old second is read, 0 with the edge, TB_MISSED if the reads around
+ * it were too far apart (or the window opened late) or -1 if the edge is
+ * not where expected.
+ */
+static int tb_capture(uint32_t next, uint32_t *edge)
+{
+        uint8_t old, new, sec;
+        uint32_t tick;
+
+        old = bin2bcd((tb_epoch + tb_span - 1) % 60);
+        new = bin2bcd((tb_epoch + tb_span) % 60);
+
+        if (tb_read_sec(&sec, &tick))
+                return -1;
+        if (sec == old) {
+                if ((int32_t)(tick - next) >= (int32_t)tb_guard)
+                        return -1;
+                tb_poll = 1;
+                tb_prev = tick;
+                clock_at(tick + TIMEBASE_STEP, tb_wake);
+                return TB_POLLING;
+        }
+        if (sec != new)
+                return -1;
+        if (!tb_poll || tick - tb_prev > TIMEBASE_MAX_GAP)
+                return TB_MISSED;
+        *edge = tick - (tick - tb_prev) / 2;
+        return 0;
+}
+
+/*
+ * Scheduler task, periodic on every Timer0 tick and run by the wake
+ * callback of timebase_init() for the reads of a capture window. A run
+ * takes one or two I2C reads.
+ */
+void timebase_task(uint8_t arg)
+{
+        uint32_t next, edge, rate;
+        int32_t wait;
+        int ret;
+
+        if (tb_ref == TB_REF_NONE) {
+                tb_search();
+                return;
+        }
+
+        next = tb_edge + tb_span * tb_rate;
+        if (!tb_poll) {
+                wait = next - tb_guard - clock_now32();
+                if (wait > (int32_t)TIMEBASE_TICK)
+                        return;
+                /* Woken when the window opens, unless it is about to */
+                if (wait > 0 && !clock_at(next - tb_guard, tb_wake))
+                        return;
+        }
+        ret = tb_capture(next, &edge);
+        if (ret == TB_POLLING)
+                return;
+        tb_poll = 0;
+        if (ret == TB_MISSED) {
+                /* Next second, the reference is dropped once it is stale */
+                if (++tb_span > 2 * TIMEBASE_WINDOW)
+                        tb_coarse();
+                return;
+        }
+        if (ret) {
+                tb_coarse();
+                return;
+        }
+
+        if (tb_ref == TB_REF_FINE) {
+                rate = (edge - tb_edge) / tb_span;
+                if (rate > CLOCK_HZ + TIMEBASE_MAX_DEV ||
+                    rate < CLOCK_HZ - TIMEBASE_MAX_DEV) {
+                        tb_coarse();
+                        return;
+                }
+                /* Smooth the read jitter of the shorter windows */
+                if (tb_rated)
+                        rate = tb_rate + ((int32_t)(rate - tb_rate)) / 4;
+                tb_set_rate(rate);
+                tb_rated = 1;
+                tb_guard = TIMEBASE_GUARD;
+        }
+        tb_epoch += tb_span;
+        tb_edge = edge;
+        tb_ref = TB_REF_FINE;
+        if (tb_rated) {
+                tb_valid = 1;
+                tb_valid_edge = tb_edge;
+                tb_valid_epoch = tb_epoch;
+        }
+        if (tb_rated)
+                tb_span = tb_span < TIMEBASE_WINDOW / 2 ?
+                                tb_span << 1 : TIMEBASE_WINDOW;
+}
+
+/* Current RTC time with milliseconds, -1 until calibrated. Task context
+ * only, like timebase_task().
+ */
+int timebase_now(struct timebase_stamp *stamp)
+{
+        uint32_t ticks, sec;
+
+        if (!tb_valid)
+                return -1;
+        ticks = clock_now32() - tb_valid_edge;
+        sec = ticks / tb_rate;
+        ticks -= sec * tb_rate;
+        stamp->sec = tb_valid_epoch + sec;
+        stamp->ms = ((uint64_t)ticks * tb_scale) >> 32;
+        return 0;
+}
+
+/* Clock ticks per RTC second */
+uint32_t timebase_get_rate(void)
+{
+        return tb_rate;
+}
+
+/* Clock deviation from the nominal CLOCK_HZ */
+int32_t timebase_get_ppm(void)
+{
+        return ((int32_t)(tb_rate - CLOCK_HZ) * 1000L) /
+                                        (int32_t)(CLOCK_HZ / 1000);
+}
@@ -0,0 +1,40 @@
+/*
+ * timebase.h
+ *
+ * Description: Calibrates the Timer1 clock (clock.h) against the DS1307
+ * seconds and provides millisecond timestamps without I2C reads.
+ *
+ * The service captures RTC second edges by polling the seconds register
+ * around the predicted edge time, first coarsely on each Timer0 tick and
+ * then in a short window of reads woken by the Timer1 compare (see
+ * timebase_task()). Clock ticks per RTC second are measured between
+ * captures that are 1, 2, 4.. TIMEBASE_WINDOW seconds apart. Timestamps
+ * are the RTC seconds of the latest captured edge plus the ticks since,
+ * scaled by the calibrated rate.
+ *
+ * Created: 2016-05-26
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#include <stdint.h>
+
+/* Max seconds between edge captures, power of two */
+#define TIMEBASE_WINDOW         16
+
+/* RTC time with milliseconds, sec as rtc_mktime() */
+struct timebase_stamp {
+        uint32_t sec;
+        uint16_t ms;
+};
+
+void timebase_init(void (*wake)(void));
+void timebase_task(uint8_t arg);
+int timebase_now(struct timebase_stamp *stamp);
+uint32_t timebase_get_rate(void);
+int32_t timebase_get_ppm(void);
+
+#endif /* TIMEBASE_H_ */
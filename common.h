@@ -13,7 +13,19 @@
 /* 16 MHz clock speed, needs to be defined before including delay.h */
 #define F_CPU 16000000UL
 #endif
+#ifdef __AVR__
 #include <util/delay.h>
+#include <avr/pgmspace.h>
+#else
+/* Host build of the drivers, see i2c/i2c_backend.h */
+#include <unistd.h>
+#define _delay_ms(ms)   usleep((ms) * 1000UL)
+#define PROGMEM
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)     (*(const uint16_t *)(addr))
+#define PSTR(s)                 (s)
+#define printf_P                printf
+#endif
 
 #define BAUD    9600
 
@@ -23,7 +35,84 @@
 /* TODO: Define EEPROM 7-bit slave address */
 #define AT24C32                 (uint8_t)0x50
 
+/* AT24C32 addresses probed at boot, bit n enables address AT24C32 + n
+ * (A2-A0 = n). The devices found are used as one linear address space.
+ */
+#define EEPROM_DEV_MASK         (uint8_t)0xFF
+
+/* EEPROM read cache lines of a page each (eeprom/eeprom.c), at least 2 or
+ * 0 to read straight from the bus.
+ */
+#define EEPROM_CACHE_LINES      4
+
+/* Un-comment to move the RTC to the bit-banged bus (i2c/soft/i2c_soft.h),
+ * SDA on PA0 and SCL on PA1, leaving the TWI to the EEPROM traffic.
+ */
+//#define I2C_SOFT_ADDR           DS1307
+
+/* Un-comment to let the board answer as an I2C peripheral (slave/slave.h) */
+//#define APP_I2C_SLAVE
+#define SLAVE_I2C_ADDR          (uint8_t)0x42
+
+/* TWI configuration, see i2c/twi/twi.h. Master-only build without the slave
+ * state machine and buffers unless the slave front end is used, master
+ * buffers sized for an AT24C32 page write (2 address bytes + 32 data bytes).
+ * The slave only receives a register address and replies zero-copy.
+ */
+#ifdef APP_I2C_SLAVE
+#define TWI_SLAVE_BUFFER_LENGTH 2
+#else
+#define TWI_MASTER_ONLY
+#endif
+#define TWI_BUFFER_LENGTH       34
+/* Queued writes without waiting, a log seal takes up to five */
+#define TWI_MASTER_BUFFERS      5
+
+/* Un-comment to record every TWI interrupt (i2c/twi/twi_trace.h), the trace
+ * is printed upon button-press and replayed with tools/twi_replay.
+ */
+//#define TWI_TRACE
+
+/* Un-comment for the production boot: no start-up delays and no RTC RAM and
+ * EEPROM demo, the RTC and the log are set up on first use. The time from
+ * reset to the first sample is printed.
+ */
+//#define FAST_BOOT
+
 /* Un-comment to activate the ADC-EEPROM Reference Application */
 //#define APP_ADC_EEPROM
 
+/* Un-comment to write the sample log packed (log/log_pack.h), up to
+ * LOG_PAGE_RECS records per EEPROM page instead of 4. Erase the log when
+ * switching.
+ */
+//#define LOG_COMPRESS
+
+/* Un-comment to save the log records not yet written (LOG_COMPRESS) when the
+ * supply drops, detected by the analog comparator on AIN1 (PE3, Arduino
+ * pin 5) against the 1.1 V bandgap. Divide the unregulated supply so AIN1
+ * reaches 1.1 V early enough for the ~10 ms the save takes.
+ */
+//#define POWER_FAIL
+
+/* Un-comment to serve the EEPROM mirror protocol (sync/sync.h) on UART0,
+ * synced to an image file on the host with tools/eeprom_mirror.
+ */
+//#define EEPROM_SYNC
+
+/* Un-comment to run the bus and device benchmark (bench/bench.h) at boot,
+ * it overwrites the last EEPROM pages.
+ */
+//#define APP_BENCHMARK
+
+/* Un-comment to profile the ISRs and the main loop (profile/profile.h),
+ * the profile is printed upon button-press.
+ */
+//#define PROFILE
+
+/* Un-comment to send the main.c diagnostics as binary frames (dlog/dlog.h),
+ * decoded on the host with tools/dlog_decode.
+ */
+//#define DLOG
+
 #endif /* COMMON_H_ */
\ No newline at end of file
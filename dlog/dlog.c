@@ -0,0 +1,112 @@
+/*
+ * dlog.c
+ *
+ * Created: 2016-06-07
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdarg.h>
+#include "../common.h"
+#include "../clock/clock.h"
+#include "../uart/uart.h"
+#include "dlog.h"
+
+#ifdef DLOG
+
+static uint32_t dlog_prev;
+static uint8_t dlog_sum;
+
+static void dlog_put(uint8_t c)
+{
+        dlog_sum += c;
+        uart0_transmit(c);
+}
+
+static void dlog_put_varint(uint32_t v)
+{
+        while (v >= 0x80) {
+                dlog_put((uint8_t)v | 0x80);
+                v >>= 7;
+        }
+        dlog_put(v);
+}
+
+static void dlog_put_str(const char *s, uint8_t flash)
+{
+        char c;
+
+        do {
+                c = flash ? pgm_read_byte(s) : *s;
+                dlog_put(c);
+                s++;
+        } while (c);
+}
+
+/* Sends the frame of a DLOG_PRINTF(), the format string (in flash) is
+ * only walked for the argument types.
+ */
+void dlog_emit(const char *fmt, ...)
+{
+        uint32_t now = clock_now32() >> DLOG_TS_SHIFT;
+        uint8_t is_long;
+        int32_t sv;
+        va_list ap;
+        char c;
+
+        dlog_sum = 0;
+        uart0_transmit(DLOG_SYNC);
+        dlog_put((uint16_t)fmt);
+        dlog_put((uint16_t)fmt >> 8);
+        dlog_put_varint((now - dlog_prev) &
+                                (0xFFFFFFFFUL >> DLOG_TS_SHIFT));
+        dlog_prev = now;
+
+        va_start(ap, fmt);
+        while ((c = pgm_read_byte(fmt++))) {
+                if (c != '%')
+                        continue;
+                /* Skip flags, width and precision */
+                do {
+                        c = pgm_read_byte(fmt++);
+                } while (c && strchr_P(PSTR("-+ #0123456789."), c));
+                is_long = 0;
+                while (c == 'l' || c == 'h') {
+                        if (c == 'l')
+                                is_long = 1;
+                        c = pgm_read_byte(fmt++);
+                }
+                switch (c) {
+                case 'd':
+                case 'i':
+                        sv = is_long ? va_arg(ap, int32_t) : va_arg(ap, int);
+                        dlog_put_varint(((uint32_t)sv << 1) ^
+                                                (uint32_t)(sv >> 31));
+                        break;
+                case 'u':
+                case 'x':
+                case 'X':
+                case 'o':
+                case 'c':
+                case 'p':
+                        dlog_put_varint(is_long ? va_arg(ap, uint32_t) :
+                                                va_arg(ap, unsigned int));
+                        break;
+                case 's':
+                        dlog_put_str(va_arg(ap, const char *), 0);
+                        break;
+                case 'S':
+                        dlog_put_str(va_arg(ap, const char *), 1);
+                        break;
+                case '\0':
+                        fmt--;
+                        break;
+                default:
+                        /* %% */
+                        break;
+                }
+        }
+        va_end(ap);
+        uart0_transmit(dlog_sum);
+}
+
+#endif /* DLOG */
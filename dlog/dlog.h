@@ -0,0 +1,48 @@
+/*
+ * dlog.h
+ *
+ * Description: Deferred-format diagnostics, enabled with DLOG in common.h.
+ * DLOG_PRINTF() keeps its format string in flash and sends a binary frame
+ * instead of the text, the format is applied on the host by
+ * tools/dlog_decode, which looks the string up in the ELF file. Without
+ * DLOG it is a plain printf_P().
+ *
+ * Frame, interleaved with the regular text output (bytes < 0x80):
+ *   DLOG_SYNC, format flash address (16-bit LE), timestamp, args, sum
+ * The timestamp is the time since the previous frame in DLOG_TS_SHIFT
+ * scaled Timer1 ticks (64 us), the args follow the format: %d/%i zigzag
+ * and %u/%x/%o/%c/%p unsigned, as base-128 varints (l for 32-bit), and
+ * %s/%S as the characters followed by a NUL. The sum is the 8-bit sum of
+ * the bytes after DLOG_SYNC. Width, flags and precision are applied on
+ * the host, '*' is not supported.
+ *
+ * Created: 2016-06-07
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef DLOG_H_
+#define DLOG_H_
+
+#include <stdio.h>
+#include "../common.h"
+
+#define DLOG_SYNC               (uint8_t)0xA5
+#define DLOG_TS_SHIFT           7
+
+#ifdef DLOG
+
+#define DLOG_PRINTF(fmt, ...)   do { \
+                static const char dlog_fmt[] PROGMEM = fmt; \
+                dlog_emit(dlog_fmt, ##__VA_ARGS__); \
+        } while (0)
+
+void dlog_emit(const char *fmt, ...);
+
+#else
+
+#define DLOG_PRINTF(fmt, ...)   printf_P(PSTR(fmt), ##__VA_ARGS__)
+
+#endif /* DLOG */
+
+#endif /* DLOG_H_ */
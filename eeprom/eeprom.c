@@ -5,71 +5,429 @@
  *  Author: alex.rodzevski
  */
 #include <stdio.h>
+#include <string.h>
 #include "eeprom.h"
 #include "../i2c/i2c.h"
+#include "../crc/crc16.h"
 #include "../common.h"
 
-int eeprom_get_page(uint8_t page_index, uint8_t *dat)
+#define EEPROM_NO_PTR           (uint16_t)0xFFFF
+#define EEPROM_NO_PAGE          (uint16_t)0xFFFF
+
+/* 7-bit addresses of the EEPROMs found by eeprom_init() */
+static uint8_t eeprom_devs[EEPROM_MAX_DEVICES];
+static uint8_t eeprom_nbr_devs;
+/* Set once the bus was probed, on first use. Finding no device is not
+ * retried until eeprom_init() is called again.
+ */
+static uint8_t eeprom_probed;
+
+/* Internal address pointer of each device, i.e. where a current address
+ * read (no address write) starts, EEPROM_NO_PTR if not known.
+ */
+static uint16_t eeprom_ptrs[EEPROM_MAX_DEVICES];
+
+/* Writes queued by eeprom_set_data_async() and not waited for, and a
+ * failure among the ones waited for since the last eeprom_flush().
+ */
+static uint8_t eeprom_queued;
+static uint8_t eeprom_wr_failed;
+
+#if EEPROM_CACHE_LINES
+/* Read cache, whole pages replaced least recently used first */
+struct eeprom_line {
+        uint16_t page;
+        uint16_t used;
+        uint8_t dat[EEPROM_PAGE_SIZE];
+};
+
+static struct eeprom_line eeprom_lines[EEPROM_CACHE_LINES];
+static uint16_t eeprom_clock;
+#endif
+
+/* Device holding linear address reg_idx. Callers check reg_idx against
+ * EEPROM_TOTAL_SIZE first, which probes the bus on first use.
+ */
+static uint8_t eeprom_dev_addr(uint16_t reg_idx)
 {
-        uint16_t reg_addr;
+        return eeprom_devs[reg_idx / EEPROM_DEV_SIZE];
+}
 
-        if (page_index >= EEPROM_NBR_PAGES)
+int eeprom_init(void)
+{
+        uint8_t i;
+
+        /* Probe each enabled A2-A0 address, the devices found make up the
+         * linear address space in address order.
+         */
+        eeprom_nbr_devs = 0;
+        eeprom_probed = 1;
+        eeprom_cache_invalidate();
+        for (i = 0; i < EEPROM_MAX_DEVICES; i++) {
+                if (!(EEPROM_DEV_MASK & (1 << i)))
+                        continue;
+                if (i2c_probe(AT24C32 + i) == 0)
+                        eeprom_devs[eeprom_nbr_devs++] = AT24C32 + i;
+        }
+        if (eeprom_nbr_devs == 0)
                 return -1;
+        return 0;
+}
+
+/* Drops the cached pages and address pointers, e.g. after the EEPROM was
+ * written behind the driver's back.
+ */
+void eeprom_cache_invalidate(void)
+{
+        uint8_t i;
+
+        for (i = 0; i < EEPROM_MAX_DEVICES; i++)
+                eeprom_ptrs[i] = EEPROM_NO_PTR;
+#if EEPROM_CACHE_LINES
+        for (i = 0; i < EEPROM_CACHE_LINES; i++)
+                eeprom_lines[i].page = EEPROM_NO_PAGE;
+#endif
+}
+
+/* Waits for the queued writes, keeping their result for eeprom_flush() */
+static void eeprom_wait(void)
+{
+        if (!eeprom_queued)
+                return;
+        eeprom_queued = 0;
+        if (i2c_flush() != 0)
+                eeprom_wr_failed = 1;
+}
+
+/* Reads within one device. If the device's address pointer is already at
+ * reg_idx, e.g. when scanning sequentially, the address write is skipped.
+ * A device in a write cycle would not answer, queued writes go first.
+ */
+static int eeprom_rd(uint16_t reg_idx, uint8_t *buf, uint8_t len)
+{
+        uint8_t dev = reg_idx / EEPROM_DEV_SIZE;
+        uint16_t ofs = reg_idx % EEPROM_DEV_SIZE;
+        int ret;
+
+        eeprom_wait();
+        if (eeprom_ptrs[dev] == ofs)
+                ret = i2c_rd_blk(eeprom_devs[dev], buf, len);
+        else
+                ret = i2c_rd_addr16_blk(eeprom_devs[dev], ofs, buf, len);
+        /* The pointer rolls over at the end of the device */
+        eeprom_ptrs[dev] = ret ? EEPROM_NO_PTR :
+                                        (ofs + len) % EEPROM_DEV_SIZE;
+        return ret;
+}
+
+#if EEPROM_CACHE_LINES
+static struct eeprom_line *eeprom_cache_find(uint16_t page)
+{
+        uint8_t i;
+
+        for (i = 0; i < EEPROM_CACHE_LINES; i++) {
+                if (eeprom_lines[i].page == page)
+                        return &eeprom_lines[i];
+        }
+        return NULL;
+}
+
+static void eeprom_cache_touch(struct eeprom_line *line)
+{
+        uint8_t i;
+
+        /* Restart the ages on wrap-around, the order is lost only once */
+        if (++eeprom_clock == 0) {
+                for (i = 0; i < EEPROM_CACHE_LINES; i++)
+                        eeprom_lines[i].used = 0;
+                eeprom_clock = 1;
+        }
+        line->used = eeprom_clock;
+}
+
+/* Reads a page into the least recently used (or a free) line */
+static struct eeprom_line *eeprom_cache_fill(uint16_t page)
+{
+        struct eeprom_line *line = &eeprom_lines[0];
+        uint8_t i;
+
+        for (i = 0; i < EEPROM_CACHE_LINES; i++) {
+                if (eeprom_lines[i].page == EEPROM_NO_PAGE) {
+                        line = &eeprom_lines[i];
+                        break;
+                }
+                if (eeprom_lines[i].used < line->used)
+                        line = &eeprom_lines[i];
+        }
+
+        line->page = EEPROM_NO_PAGE;
+        if (eeprom_rd(page * EEPROM_PAGE_SIZE, line->dat, EEPROM_PAGE_SIZE))
+                return NULL;
+        line->page = page;
+        eeprom_cache_touch(line);
+        return line;
+}
+
+/* Reads the page following one just read to its end, the device pointer
+ * is already there so only START and the client address go on the bus.
+ */
+static void eeprom_cache_prefetch(uint16_t page)
+{
+        if (page % EEPROM_DEV_PAGES == 0 || page >= EEPROM_NBR_PAGES)
+                return;
+        if (!eeprom_cache_find(page))
+                eeprom_cache_fill(page);
+}
+
+#endif
+
+/* Invalidates the cached pages overlapping a write, whether it succeeded
+ * or not, and the address pointers the write moved.
+ */
+static void eeprom_written(uint16_t reg_idx, uint16_t len)
+{
+#if EEPROM_CACHE_LINES
+        uint16_t first = reg_idx / EEPROM_PAGE_SIZE;
+        uint16_t last = (reg_idx + len - 1) / EEPROM_PAGE_SIZE;
+#endif
+        uint8_t i;
+
+        for (i = 0; i < EEPROM_MAX_DEVICES; i++)
+                eeprom_ptrs[i] = EEPROM_NO_PTR;
+#if EEPROM_CACHE_LINES
+        for (i = 0; i < EEPROM_CACHE_LINES; i++) {
+                if (eeprom_lines[i].page >= first &&
+                    eeprom_lines[i].page <= last)
+                        eeprom_lines[i].page = EEPROM_NO_PAGE;
+        }
+#endif
+}
+
+uint16_t eeprom_get_size(void)
+{
+        if (!eeprom_probed)
+                eeprom_init();
+        return eeprom_nbr_devs * EEPROM_DEV_SIZE;
+}
 
-        reg_addr = (page_index * EEPROM_PAGE_SIZE);
-        return i2c_rd_addr16_blk(AT24C32, reg_addr, dat, EEPROM_PAGE_SIZE);
+uint16_t eeprom_get_nbr_pages(void)
+{
+        return eeprom_get_size() / EEPROM_PAGE_SIZE;
 }
 
-int eeprom_set_page(uint8_t page_index, uint8_t *dat)
+int eeprom_get_page(uint16_t page_index, uint8_t *dat)
 {
-        uint16_t reg_addr;
+        if (page_index >= EEPROM_NBR_PAGES)
+                return -1;
+
+        return eeprom_get_data(page_index * EEPROM_PAGE_SIZE, dat,
+                                                        EEPROM_PAGE_SIZE);
+}
 
+int eeprom_set_page(uint16_t page_index, uint8_t *dat)
+{
         if (page_index >= EEPROM_NBR_PAGES)
                 return -1;
 
-        reg_addr = (page_index * EEPROM_PAGE_SIZE);
-        return i2c_wr_addr16_blk(AT24C32, reg_addr, dat, EEPROM_PAGE_SIZE);
+        return eeprom_set_data(page_index * EEPROM_PAGE_SIZE, dat,
+                                                        EEPROM_PAGE_SIZE);
 }
 
-int eeprom_get_data(uint16_t reg_idx, uint8_t *buf, uint16_t len)
+/* Reads straight from the bus, the cache is neither looked up nor filled,
+ * e.g. to time the bus reads. The address write is still skipped when the
+ * device pointer is at reg_idx.
+ */
+int eeprom_get_data_uncached(uint16_t reg_idx, uint8_t *buf, uint16_t len)
 {
-        if ((reg_idx + len) > EEPROM_TOTAL_SIZE)
+        uint16_t chunk_len;
+        int ret;
+
+        if ((uint32_t)reg_idx + len > EEPROM_TOTAL_SIZE)
                 return -1;
 
-        return i2c_rd_addr16_blk(AT24C32, reg_idx, buf, len);
+        /* Sequential reads roll over at the end of a device, split there and
+         * in blocks the I2C layer can handle in one read.
+         */
+        while (len) {
+                chunk_len = EEPROM_DEV_SIZE - (reg_idx % EEPROM_DEV_SIZE);
+                if (chunk_len > len)
+                        chunk_len = len;
+                if (chunk_len > 0xFF)
+                        chunk_len = 0xFF;
+                ret = eeprom_rd(reg_idx, buf, chunk_len);
+                if (ret)
+                        return ret;
+                reg_idx += chunk_len;
+                buf += chunk_len;
+                len -= chunk_len;
+        }
+        return 0;
 }
 
-int eeprom_set_data(uint16_t reg_idx, uint8_t *buf, uint16_t len)
+#if EEPROM_CACHE_LINES
+int eeprom_get_data(uint16_t reg_idx, uint8_t *buf, uint16_t len)
 {
-        uint8_t page_overflow_len;
-        uint8_t page_rest_len;
-        uint8_t ret;
+        struct eeprom_line *line;
+        uint8_t ofs, chunk_len;
+        uint16_t page;
+
+        if ((uint32_t)reg_idx + len > EEPROM_TOTAL_SIZE)
+                return -1;
 
-        /* Note! The length is limited to a page size only. If needed multi-page
-         * handling this needs to be adjusted.
+        /* Page by page through the cache. A read up to the end of a page
+         * is taken as a sequential scan and fetches the next page as well.
          */
-        if (len > EEPROM_PAGE_SIZE || (reg_idx + len) > EEPROM_TOTAL_SIZE)
+        while (len) {
+                page = reg_idx / EEPROM_PAGE_SIZE;
+                ofs = reg_idx % EEPROM_PAGE_SIZE;
+                chunk_len = EEPROM_PAGE_SIZE - ofs;
+                if (chunk_len > len)
+                        chunk_len = len;
+                line = eeprom_cache_find(page);
+                if (line)
+                        eeprom_cache_touch(line);
+                else
+                        line = eeprom_cache_fill(page);
+                if (!line)
+                        return -1;
+                memcpy(buf, &line->dat[ofs], chunk_len);
+                if (ofs + chunk_len == EEPROM_PAGE_SIZE)
+                        eeprom_cache_prefetch(page + 1);
+                reg_idx += chunk_len;
+                buf += chunk_len;
+                len -= chunk_len;
+        }
+        return 0;
+}
+#else
+int eeprom_get_data(uint16_t reg_idx, uint8_t *buf, uint16_t len)
+{
+        return eeprom_get_data_uncached(reg_idx, buf, len);
+}
+#endif
+
+/* Queues the page writes and returns, the data is copied. Reads wait for
+ * them, eeprom_flush() reports whether they succeeded.
+ */
+int eeprom_set_data_async(uint16_t reg_idx, uint8_t *buf, uint16_t len)
+{
+        uint8_t chunk_len;
+        int ret = 0;
+
+        if ((uint32_t)reg_idx + len > EEPROM_TOTAL_SIZE)
                 return -1;
+        eeprom_written(reg_idx, len);
 
         /* Page boundary handling. When crossing the page boundary the new page
          * needs to be explicitly addressed, else current page will be over-
-         * written.
+         * written. Device boundaries are page boundaries as well. The page
+         * writes are queued back-to-back, the next one is copied while the
+         * previous is on the bus and the TWI ISR ACK-polls the EEPROM through
+         * each write cycle.
          */
-        if ((reg_idx % EEPROM_PAGE_SIZE) + len > EEPROM_PAGE_SIZE) {
-                page_overflow_len = ((reg_idx % EEPROM_PAGE_SIZE) + len) -
-                                                        EEPROM_PAGE_SIZE;
-                page_rest_len = (len > page_overflow_len ?
-                                        len - page_overflow_len :
-                                                page_overflow_len - len);
-                ret = i2c_wr_addr16_blk(AT24C32, reg_idx, buf, page_rest_len);
+        while (len) {
+                chunk_len = EEPROM_PAGE_SIZE - (reg_idx % EEPROM_PAGE_SIZE);
+                if (chunk_len > len)
+                        chunk_len = len;
+                ret = i2c_wr_addr16_blk_async(eeprom_dev_addr(reg_idx),
+                                        reg_idx % EEPROM_DEV_SIZE,
+                                        buf, chunk_len);
                 if (ret)
-                        return ret;
-                _delay_ms(100);
-                ret = i2c_wr_addr16_blk(AT24C32,
-                                        (reg_idx + len) - page_overflow_len,
-                                        &buf[page_rest_len], page_overflow_len);
-        } else {
-                ret = i2c_wr_addr16_blk(AT24C32, reg_idx, buf, len);
+                        break;
+                eeprom_queued = 1;
+                reg_idx += chunk_len;
+                buf += chunk_len;
+                len -= chunk_len;
         }
-        return ret;   
-}
\ No newline at end of file
+        return ret;
+}
+
+/* Waits for the queued writes, -1 if any failed since the last call */
+int eeprom_flush(void)
+{
+        uint8_t failed;
+
+        eeprom_wait();
+        failed = eeprom_wr_failed;
+        eeprom_wr_failed = 0;
+        return failed ? -1 : 0;
+}
+
+int eeprom_set_data(uint16_t reg_idx, uint8_t *buf, uint16_t len)
+{
+        int ret = eeprom_set_data_async(reg_idx, buf, len);
+
+        if (eeprom_flush() != 0)
+                ret = -1;
+        return ret;
+}
+
+/* Reads back a record written by eeprom_set_record() into buf (size
+ * bytes), the CRC is checked as part of the read. Returns the payload
+ * length, or -1 on a bus error, a too small buf or a CRC mismatch (also
+ * for erased EEPROM).
+ */
+int eeprom_get_record(uint16_t reg_idx, uint8_t *buf, uint8_t size)
+{
+        uint8_t len, crc_buf[2];
+        uint16_t crc;
+
+        if (eeprom_get_data(reg_idx, &len, 1) || len > size)
+                return -1;
+        if (eeprom_get_data(reg_idx + 1, buf, len) ||
+            eeprom_get_data(reg_idx + 1 + len, crc_buf, 2))
+                return -1;
+
+        crc = crc16_byte(CRC16_INIT, len);
+        crc = crc16_update(crc, buf, len);
+        if (crc != (((uint16_t)crc_buf[0] << 8) | crc_buf[1]))
+                return -1;
+        return len;
+}
+
+/* Writes len bytes as a record of EEPROM_REC_SIZE(len) bytes. The record
+ * is assembled page by page and the CRC is updated as each byte is staged,
+ * no read-back is needed.
+ */
+int eeprom_set_record(uint16_t reg_idx, const uint8_t *buf, uint8_t len)
+{
+        uint8_t chunk[EEPROM_PAGE_SIZE];
+        uint16_t size = EEPROM_REC_SIZE(len);
+        uint16_t crc = CRC16_INIT;
+        uint16_t pos = 0;
+        uint8_t chunk_len, i;
+        int ret = 0;
+
+        if ((uint32_t)reg_idx + size > EEPROM_TOTAL_SIZE)
+                return -1;
+        eeprom_written(reg_idx, size);
+
+        while (pos < size) {
+                chunk_len = EEPROM_PAGE_SIZE - (reg_idx % EEPROM_PAGE_SIZE);
+                if (chunk_len > size - pos)
+                        chunk_len = size - pos;
+                for (i = 0; i < chunk_len; i++, pos++) {
+                        if (pos == 0)
+                                chunk[i] = len;
+                        else if (pos <= len)
+                                chunk[i] = buf[pos - 1];
+                        else if (pos == len + 1)
+                                chunk[i] = crc >> 8;
+                        else
+                                chunk[i] = crc;
+                        if (pos <= len)
+                                crc = crc16_byte(crc, chunk[i]);
+                }
+                ret = i2c_wr_addr16_blk_async(eeprom_dev_addr(reg_idx),
+                                        reg_idx % EEPROM_DEV_SIZE,
+                                        chunk, chunk_len);
+                if (ret)
+                        break;
+                eeprom_queued = 1;
+                reg_idx += chunk_len;
+        }
+
+        if (eeprom_flush() != 0)
+                ret = -1;
+        return ret;
+}
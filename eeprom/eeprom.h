@@ -9,13 +9,37 @@
 #ifndef EEPROM_H_
 #define EEPROM_H_
 
-#define EEPROM_TOTAL_SIZE       (uint16_t)4096  /* Bytes */
+#include <stdint.h>
+
+#define EEPROM_DEV_SIZE         (uint16_t)4096  /* Bytes per AT24C32 */
 #define EEPROM_PAGE_SIZE        (uint8_t)32     /* Bytes */
-#define EEPROM_NBR_PAGES        (uint8_t)128    /* 4096 / 32 */
+#define EEPROM_DEV_PAGES        (uint8_t)128    /* 4096 / 32 */
+#define EEPROM_MAX_DEVICES      (uint8_t)8      /* Addressed by A0-A2 */
+
+/* The EEPROMs found on the bus (see EEPROM_DEV_MASK in common.h) are
+ * presented as one linear address space, in device address order.
+ */
+/* Record framing of eeprom_set/get_record(): length byte, payload and a
+ * CRC-16 (big endian) over length and payload.
+ */
+#define EEPROM_REC_OVERHEAD     (uint8_t)3
+#define EEPROM_REC_SIZE(len)    ((len) + EEPROM_REC_OVERHEAD)
+
+#define EEPROM_TOTAL_SIZE       eeprom_get_size()
+#define EEPROM_NBR_PAGES        eeprom_get_nbr_pages()
 
-int eeprom_get_page(uint8_t page_index, uint8_t *dat);
-int eeprom_set_page(uint8_t page_index, uint8_t *dat);
+int eeprom_init(void);
+void eeprom_cache_invalidate(void);
+uint16_t eeprom_get_size(void);
+uint16_t eeprom_get_nbr_pages(void);
+int eeprom_get_page(uint16_t page_index, uint8_t *dat);
+int eeprom_set_page(uint16_t page_index, uint8_t *dat);
 int eeprom_get_data(uint16_t reg_idx, uint8_t *buf, uint16_t len);
+int eeprom_get_data_uncached(uint16_t reg_idx, uint8_t *buf, uint16_t len);
 int eeprom_set_data(uint16_t reg_idx, uint8_t *buf, uint16_t len);
+int eeprom_set_data_async(uint16_t reg_idx, uint8_t *buf, uint16_t len);
+int eeprom_flush(void);
+int eeprom_get_record(uint16_t reg_idx, uint8_t *buf, uint8_t size);
+int eeprom_set_record(uint16_t reg_idx, const uint8_t *buf, uint8_t len);
 
-#endif /* EEPROM_H_ */
\ No newline at end of file
+#endif /* EEPROM_H_ */
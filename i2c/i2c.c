@@ -0,0 +1,208 @@
+/*
+ * i2c.c
+ *
+ * Description: This file contains the bus independent part of the i2c
+ * wrapper. Every call is mapped onto the batch/submit primitives of the
+ * backend selected at build time, see i2c_backend.h.
+ *
+ * Created: 2016-05-09
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stddef.h>
+#include "../common.h"
+#include "i2c.h"
+#include "i2c_backend.h"
+
+#if defined(I2C_BACKEND_LINUX)
+#define i2c_be  (&i2c_linux_backend)
+#elif defined(I2C_BACKEND_SIM)
+#define i2c_be  (&i2c_sim_backend)
+#else
+#define i2c_be  (&i2c_twi_backend)
+#ifdef I2C_SOFT_ADDR
+#define I2C_SOFT_BUS
+#endif
+#endif
+
+/* The client at I2C_SOFT_ADDR is on the bit-banged bus, i2c/soft/i2c_soft.h */
+#ifdef I2C_SOFT_BUS
+#define i2c_be_of(cli_addr)     ((cli_addr) == I2C_SOFT_ADDR ? \
+                                        &i2c_soft_backend : i2c_be)
+#else
+#define i2c_be_of(cli_addr)     i2c_be
+#endif
+
+/* Single op transaction: an optional write (e.g. register address) followed
+ * by an optional repeated START read.
+ */
+static int i2c_wr_rd(uint8_t cli_addr, uint8_t *wr_dat, uint8_t wr_len,
+                                                uint8_t *rd_dat, uint8_t rd_len)
+{
+        struct i2c_op op;
+
+        op.cli_addr = cli_addr;
+        op.flags = 0;
+        op.wr_dat = wr_dat;
+        op.wr_len = wr_len;
+        op.rd_dat = rd_dat;
+        op.rd_len = rd_len;
+        return i2c_be_of(cli_addr)->xfer(&op, 1);
+}
+
+/* Write hdr + dat as one transaction and wait for it */
+static int i2c_wr(uint8_t cli_addr, const uint8_t *hdr, uint8_t hdr_len,
+                                                const uint8_t *dat, uint8_t len)
+{
+        const struct i2c_backend *be = i2c_be_of(cli_addr);
+
+        if (be->submit(cli_addr, hdr, hdr_len, dat, len) != 0)
+                return -1;
+        return be->flush();
+}
+
+void i2c_init(void)
+{
+        i2c_be->init();
+#ifdef I2C_SOFT_BUS
+        i2c_soft_backend.init();
+#endif
+}
+
+/* Sets the clock of the main bus, the bit-banged bus keeps I2C_SOFT_FREQ */
+void i2c_set_clk(unsigned long f_cpu, uint32_t frequency)
+{
+        i2c_be->set_clk(f_cpu, frequency);
+}
+
+int i2c_probe(uint8_t cli_addr)
+{
+        /* Address-only write, the client ACKs if present (and not busy) */
+        return i2c_wr_rd(cli_addr, NULL, 0, NULL, 0);
+}
+
+int i2c_rd_byte(uint8_t cli_addr, uint8_t *dat)
+{
+        return i2c_wr_rd(cli_addr, NULL, 0, dat, 1);
+}
+
+int i2c_rd_addr_byte(uint8_t cli_addr, uint8_t reg_addr, uint8_t *dat)
+{
+        return i2c_wr_rd(cli_addr, &reg_addr, 1, dat, 1);
+}
+
+int i2c_rd_addr16_byte(uint8_t cli_addr, uint16_t reg_addr, uint8_t *dat)
+{
+        uint8_t buf[2];
+
+        buf[0] = (uint8_t)((0xFF00 & reg_addr) >> 8);   /* reg addr MSB */
+        buf[1] = (uint8_t)(0x00FF & reg_addr);          /* reg addr LSB */
+        return i2c_wr_rd(cli_addr, buf, sizeof(buf), dat, 1);
+}
+
+int i2c_rd_blk(uint8_t cli_addr, uint8_t *dat, uint8_t len)
+{
+        return i2c_wr_rd(cli_addr, NULL, 0, dat, len);
+}
+
+int i2c_rd_addr_blk(uint8_t cli_addr, uint8_t reg_addr,
+                                                uint8_t *dat, uint8_t len)
+{
+        return i2c_wr_rd(cli_addr, &reg_addr, 1, dat, len);
+}
+
+int i2c_rd_addr16_blk(uint8_t cli_addr, uint16_t reg_addr,
+                                                uint8_t *dat, uint8_t len)
+{
+        uint8_t buf[2];
+
+        buf[0] = (uint8_t)((0xFF00 & reg_addr) >> 8);   /* reg addr MSB */
+        buf[1] = (uint8_t)(0x00FF & reg_addr);          /* reg addr LSB */
+        return i2c_wr_rd(cli_addr, buf, sizeof(buf), dat, len);
+}
+
+int i2c_wr_byte(uint8_t cli_addr, uint8_t dat)
+{
+        return i2c_wr(cli_addr, NULL, 0, &dat, 1);
+}
+
+int i2c_wr_addr_byte(uint8_t cli_addr, uint8_t reg_addr, uint8_t dat)
+{
+        return i2c_wr(cli_addr, &reg_addr, 1, &dat, 1);
+}
+
+int i2c_wr_addr16_byte(uint8_t cli_addr, uint16_t reg_addr, uint8_t dat)
+{
+        uint8_t buf[2];
+
+        buf[0] = (uint8_t)((0xFF00 & reg_addr) >> 8);   /* reg addr MSB */
+        buf[1] = (uint8_t)(0x00FF & reg_addr);          /* reg addr LSB */
+        return i2c_wr(cli_addr, buf, sizeof(buf), &dat, 1);
+}
+
+int i2c_wr_blk(uint8_t cli_addr, uint8_t *dat, uint8_t len)
+{
+        return i2c_wr(cli_addr, NULL, 0, dat, len);
+}
+
+int i2c_wr_addr_blk(uint8_t cli_addr, uint8_t reg_addr,
+                                                uint8_t *dat, uint8_t len)
+{
+        const struct i2c_backend *be = i2c_be_of(cli_addr);
+        uint8_t chunk_len;
+
+        /* The register address and data are copied straight into the
+         * backend's write buffers. Blocks larger than a buffer are split,
+         * relying on the client's register address auto-increment.
+         */
+        while (len) {
+                chunk_len = be->max_wr_len - 1;
+                if (chunk_len > len)
+                        chunk_len = len;
+                if (be->submit(cli_addr, &reg_addr, 1, dat, chunk_len))
+                        return -1;
+                reg_addr += chunk_len;
+                dat += chunk_len;
+                len -= chunk_len;
+        }
+        return be->flush();
+}
+
+int i2c_wr_addr16_blk(uint8_t cli_addr, uint16_t reg_addr,
+                                                uint8_t *dat, uint8_t len)
+{
+        if (i2c_wr_addr16_blk_async(cli_addr, reg_addr, dat, len) != 0)
+                return -1;
+        return i2c_be_of(cli_addr)->flush();
+}
+
+int i2c_wr_addr16_blk_async(uint8_t cli_addr, uint16_t reg_addr,
+                                                uint8_t *dat, uint8_t len)
+{
+        uint8_t buf[2];
+
+        buf[0] = (uint8_t)((0xFF00 & reg_addr) >> 8);   /* reg addr MSB */
+        buf[1] = (uint8_t)(0x00FF & reg_addr);          /* reg addr LSB */
+        return i2c_be_of(cli_addr)->submit(cli_addr, buf, sizeof(buf),
+                                                                dat, len);
+}
+
+int i2c_flush(void)
+{
+#ifdef I2C_SOFT_BUS
+        int err = i2c_be->flush();
+        int soft_err = i2c_soft_backend.flush();
+
+        return err ? err : soft_err;
+#else
+        return i2c_be->flush();
+#endif
+}
+
+/* A batch runs on the bus of its first op, i.e. all ops must address
+ * clients on the same bus.
+ */
+int i2c_batch(struct i2c_op *ops, uint8_t nbr_ops)
+{
+        return i2c_be_of(ops[0].cli_addr)->xfer(ops, nbr_ops);
+}
@@ -9,8 +9,34 @@
 #ifndef I2C_H_
 #define I2C_H_
 
+#include <stdint.h>
+
+/* Batched transaction op, see i2c_batch(). An op is a write, a read or a
+ * write followed by a repeated START read (e.g. register address + data).
+ */
+struct i2c_op {
+        uint8_t cli_addr;       /* 7-bit client address */
+        uint8_t flags;          /* I2C_OP_STOP etc. */
+        uint8_t *wr_dat;        /* Data to write, may be NULL if wr_len is 0 */
+        uint8_t wr_len;
+        uint8_t *rd_dat;        /* Read buffer, may be NULL if rd_len is 0 */
+        uint8_t rd_len;
+        uint8_t status;         /* Set by i2c_batch(), I2C_OP_OK on success */
+};
+
+/* i2c_op flags */
+#define I2C_OP_STOP             (uint8_t)0x01   /* STOP (not Sr) after op */
+
+/* i2c_op status */
+#define I2C_OP_OK               (uint8_t)0
+#define I2C_OP_ADDR_NACK        (uint8_t)2      /* Client address NACKed */
+#define I2C_OP_DATA_NACK        (uint8_t)3      /* Written data NACKed */
+#define I2C_OP_BUS_ERR          (uint8_t)4      /* Arbitration lost etc. */
+#define I2C_OP_PENDING          (uint8_t)0xFF   /* Not executed */
+
 void i2c_init(void);
 void i2c_set_clk(unsigned long f_cpu, uint32_t frequency);
+int i2c_probe(uint8_t cli_addr);
 int i2c_rd_byte(uint8_t cli_addr, uint8_t *dat);
 int i2c_rd_addr_byte(uint8_t cli_addr, uint8_t reg_addr, uint8_t *dat);
 int i2c_rd_addr16_byte(uint8_t cli_addr, uint16_t reg_addr, uint8_t *dat);
@@ -27,5 +53,9 @@ int i2c_wr_addr_blk(uint8_t cli_addr, uint8_t reg_addr,
                                                 uint8_t *dat, uint8_t len);
 int i2c_wr_addr16_blk(uint8_t cli_addr, uint16_t reg_addr,
                                                 uint8_t *dat, uint8_t len);
+int i2c_wr_addr16_blk_async(uint8_t cli_addr, uint16_t reg_addr,
+                                                uint8_t *dat, uint8_t len);
+int i2c_flush(void);
+int i2c_batch(struct i2c_op *ops, uint8_t nbr_ops);
 
 #endif /* I2C_H_ */
\ No newline at end of file
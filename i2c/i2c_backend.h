@@ -0,0 +1,45 @@
+/*
+ * i2c_backend.h
+ *
+ * Description: Interface between the generic i2c layer (i2c.c) and the bus
+ * implementations. The backend is selected at build time:
+ *   (default)          AVR TWI, twi/twi_wrapper.c
+ *   I2C_BACKEND_LINUX  Linux /dev/i2c-N, linux/i2c_linux.c
+ *   I2C_BACKEND_SIM    In-memory DS1307 + AT24C32 model, sim/i2c_sim.c
+ * On AVR the client at I2C_SOFT_ADDR can be moved to a second, bit-banged
+ * bus, soft/i2c_soft.c.
+ *
+ * Created: 2016-05-09
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef I2C_BACKEND_H_
+#define I2C_BACKEND_H_
+
+#include "i2c.h"
+
+struct i2c_backend {
+        void (*init)(void);
+        void (*set_clk)(unsigned long f_cpu, uint32_t frequency);
+        /* Run a batch of ops, blocking. 0 on success, else -1 with the
+         * failing op's status set, see i2c_batch().
+         */
+        int (*xfer)(struct i2c_op *ops, uint8_t nbr_ops);
+        /* Queue a write of hdr followed by dat, ACK-polling a busy client.
+         * 0 if queued, -1 if it can never be sent (too long).
+         */
+        int (*submit)(uint8_t cli_addr, const uint8_t *hdr, uint8_t hdr_len,
+                                        const uint8_t *dat, uint8_t len);
+        /* Wait for queued writes, 0 or the first I2C_OP_xxx error status */
+        int (*flush)(void);
+        /* Largest hdr_len + len accepted by submit() */
+        uint8_t max_wr_len;
+};
+
+extern const struct i2c_backend i2c_twi_backend;
+extern const struct i2c_backend i2c_linux_backend;
+extern const struct i2c_backend i2c_sim_backend;
+extern const struct i2c_backend i2c_soft_backend;
+
+#endif /* I2C_BACKEND_H_ */
@@ -0,0 +1,94 @@
+/*
+ * i2c_regs.h
+ *
+ * Description: Compile-time register field descriptors for I2C devices.
+ * A field is described by a macro expanding to "register, shift, width",
+ * e.g.
+ *
+ *   #define DS1307_SEC_10   DS1307_REG_SEC, 4, 3
+ *
+ * The accessors below are static inline with constant descriptors, so they
+ * fold into the same mask/shift code as hand-written C. Register images are
+ * plain arrays indexed by register address, I2C_REGS_RD() reads the span
+ * covering a set of fields in one burst.
+ *
+ * Created: 2016-05-16
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef I2C_REGS_H_
+#define I2C_REGS_H_
+
+#include <stdint.h>
+#include "i2c.h"
+
+static inline uint8_t i2c_field_reg(uint8_t reg, uint8_t shift, uint8_t width)
+{
+        (void)shift;
+        (void)width;
+        return reg;
+}
+
+static inline uint8_t i2c_field_mask(uint8_t reg, uint8_t shift, uint8_t width)
+{
+        (void)reg;
+        return (uint8_t)(((1 << width) - 1) << shift);
+}
+
+static inline uint8_t i2c_field_get(const uint8_t *regs, uint8_t reg,
+                                                uint8_t shift, uint8_t width)
+{
+        return (regs[reg] >> shift) & ((1 << width) - 1);
+}
+
+static inline void i2c_field_set(uint8_t *regs, uint8_t reg, uint8_t shift,
+                                                uint8_t width, uint8_t val)
+{
+        uint8_t mask = (uint8_t)(((1 << width) - 1) << shift);
+
+        regs[reg] = (regs[reg] & ~mask) | ((val << shift) & mask);
+}
+
+static inline uint8_t bcd2bin(uint8_t bcd)
+{
+        return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+static inline uint8_t bin2bcd(uint8_t bin)
+{
+        return ((bin / 10) << 4) | (bin % 10);
+}
+
+/* The macro layer expands a field descriptor into the argument list. The
+ * descriptor is the trailing (variadic) argument since it holds commas.
+ */
+#define I2C_FIELD_REG(...)              i2c_field_reg(__VA_ARGS__)
+#define I2C_FIELD_MASK(...)             i2c_field_mask(__VA_ARGS__)
+#define I2C_FIELD_GET(regs, ...)        i2c_field_get(regs, __VA_ARGS__)
+#define I2C_FIELD_GET_BCD(regs, ...)    bcd2bin(i2c_field_get(regs, __VA_ARGS__))
+#define I2C_FIELD_SET(regs, val, ...)   i2c_field_set(regs, __VA_ARGS__, val)
+#define I2C_FIELD_SET_BCD(regs, val, ...) \
+        i2c_field_set(regs, __VA_ARGS__, bin2bcd(val))
+
+#define I2C_REG_MIN(a, b)               ((a) < (b) ? (a) : (b))
+#define I2C_REG_MAX(a, b)               ((a) > (b) ? (a) : (b))
+
+/* Read/write the registers spanned by fields fa..fb (in any order) of an
+ * 8-bit register address device in one burst, regs is the register image.
+ */
+#define I2C_REGS_RD(cli_addr, regs, fa, fb)                                 \
+        i2c_rd_addr_blk(cli_addr,                                           \
+                I2C_REG_MIN(I2C_FIELD_REG(fa), I2C_FIELD_REG(fb)),          \
+                &(regs)[I2C_REG_MIN(I2C_FIELD_REG(fa), I2C_FIELD_REG(fb))], \
+                I2C_REG_MAX(I2C_FIELD_REG(fa), I2C_FIELD_REG(fb)) -         \
+                I2C_REG_MIN(I2C_FIELD_REG(fa), I2C_FIELD_REG(fb)) + 1)
+
+#define I2C_REGS_WR(cli_addr, regs, fa, fb)                                 \
+        i2c_wr_addr_blk(cli_addr,                                           \
+                I2C_REG_MIN(I2C_FIELD_REG(fa), I2C_FIELD_REG(fb)),          \
+                &(regs)[I2C_REG_MIN(I2C_FIELD_REG(fa), I2C_FIELD_REG(fb))], \
+                I2C_REG_MAX(I2C_FIELD_REG(fa), I2C_FIELD_REG(fb)) -         \
+                I2C_REG_MIN(I2C_FIELD_REG(fa), I2C_FIELD_REG(fb)) + 1)
+
+#endif /* I2C_REGS_H_ */
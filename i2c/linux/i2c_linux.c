@@ -0,0 +1,172 @@
+/*
+ * i2c_linux.c
+ *
+ * Description: Linux i2c-dev backend (I2C_BACKEND_LINUX) so the rtc/eeprom
+ * drivers can run on a Linux gateway talking to the Tiny RTC board. A batch
+ * is issued as combined I2C_RDWR messages, i.e. with repeated STARTs and a
+ * single STOP, in one ioctl per run of ops up to an I2C_OP_STOP.
+ *
+ * The adapter is I2C_LINUX_DEV, or the I2C_DEV environment variable if set.
+ * The adapter must support plain I2C transfers (I2C_FUNC_I2C).
+ *
+ * Created: 2016-05-09
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "../i2c_backend.h"
+
+#ifndef I2C_LINUX_DEV
+#define I2C_LINUX_DEV           "/dev/i2c-1"
+#endif
+
+/* Address NACK retries of a write, covers an EEPROM write cycle */
+#define I2C_LINUX_ACK_POLLS     100
+#define I2C_LINUX_ACK_POLL_US   100
+
+/* Ops per ioctl, each op is at most a write and a read message */
+#define I2C_LINUX_MAX_OPS       (I2C_RDRW_IOCTL_MAX_MSGS / 2)
+
+static int i2c_fd = -1;
+static int i2c_wr_error;
+
+/* No ACK from the client, reported as ENXIO or EREMOTEIO by the drivers */
+static uint8_t i2c_linux_status(int err)
+{
+        if (err == ENXIO || err == EREMOTEIO)
+                return I2C_OP_ADDR_NACK;
+        return I2C_OP_BUS_ERR;
+}
+
+static void i2c_linux_init(void)
+{
+        const char *dev = getenv("I2C_DEV");
+        unsigned long funcs;
+
+        if (dev == NULL)
+                dev = I2C_LINUX_DEV;
+        i2c_fd = open(dev, O_RDWR);
+        if (i2c_fd < 0) {
+                fprintf(stderr, "i2c: open %s: %s\n", dev, strerror(errno));
+                return;
+        }
+        if (ioctl(i2c_fd, I2C_FUNCS, &funcs) < 0 || !(funcs & I2C_FUNC_I2C))
+                fprintf(stderr, "i2c: %s has no I2C_RDWR support\n", dev);
+}
+
+static void i2c_linux_set_clk(unsigned long f_cpu, uint32_t frequency)
+{
+        /* The bus clock is set by the kernel adapter driver */
+        (void)f_cpu;
+        (void)frequency;
+}
+
+static int i2c_linux_rdwr(struct i2c_msg *msgs, uint8_t nbr_msgs)
+{
+        struct i2c_rdwr_ioctl_data rdwr;
+
+        rdwr.msgs = msgs;
+        rdwr.nmsgs = nbr_msgs;
+        if (ioctl(i2c_fd, I2C_RDWR, &rdwr) < 0)
+                return errno;
+        return 0;
+}
+
+static int i2c_linux_xfer(struct i2c_op *ops, uint8_t nbr_ops)
+{
+        struct i2c_msg msgs[I2C_LINUX_MAX_OPS * 2];
+        uint8_t first, i, n;
+        int err;
+
+        for (i = 0; i < nbr_ops; i++)
+                ops[i].status = I2C_OP_PENDING;
+
+        /* One ioctl per run of ops up to an I2C_OP_STOP (or full array) */
+        for (first = 0; first < nbr_ops; first = i) {
+                n = 0;
+                for (i = first; i < nbr_ops; i++) {
+                        if (ops[i].wr_len || !ops[i].rd_len) {
+                                msgs[n].addr = ops[i].cli_addr;
+                                msgs[n].flags = 0;
+                                msgs[n].len = ops[i].wr_len;
+                                msgs[n].buf = ops[i].wr_dat;
+                                n++;
+                        }
+                        if (ops[i].rd_len) {
+                                msgs[n].addr = ops[i].cli_addr;
+                                msgs[n].flags = I2C_M_RD;
+                                msgs[n].len = ops[i].rd_len;
+                                msgs[n].buf = ops[i].rd_dat;
+                                n++;
+                        }
+                        if ((ops[i].flags & I2C_OP_STOP) ||
+                                        i - first + 1 == I2C_LINUX_MAX_OPS) {
+                                i++;
+                                break;
+                        }
+                }
+
+                err = i2c_linux_rdwr(msgs, n);
+                if (err) {
+                        /* The kernel doesn't tell which message failed */
+                        ops[first].status = i2c_linux_status(err);
+                        return -1;
+                }
+                for (n = first; n < i; n++)
+                        ops[n].status = I2C_OP_OK;
+        }
+        return 0;
+}
+
+static int i2c_linux_submit(uint8_t cli_addr, const uint8_t *hdr,
+                        uint8_t hdr_len, const uint8_t *dat, uint8_t len)
+{
+        uint8_t buf[2 * 0xFF];
+        struct i2c_msg msg;
+        int polls = I2C_LINUX_ACK_POLLS;
+        int err;
+
+        /* Writes are done right away, flush only reports the error */
+        if (hdr_len)
+                memcpy(buf, hdr, hdr_len);
+        if (len)
+                memcpy(&buf[hdr_len], dat, len);
+        msg.addr = cli_addr;
+        msg.flags = 0;
+        msg.len = hdr_len + len;
+        msg.buf = buf;
+
+        while ((err = i2c_linux_rdwr(&msg, 1)) != 0 &&
+                        i2c_linux_status(err) == I2C_OP_ADDR_NACK &&
+                        polls-- > 0)
+                usleep(I2C_LINUX_ACK_POLL_US);
+
+        if (err && i2c_wr_error == 0)
+                i2c_wr_error = i2c_linux_status(err);
+        return 0;
+}
+
+static int i2c_linux_flush(void)
+{
+        int err = i2c_wr_error;
+
+        i2c_wr_error = 0;
+        return err;
+}
+
+const struct i2c_backend i2c_linux_backend = {
+        .init = i2c_linux_init,
+        .set_clk = i2c_linux_set_clk,
+        .xfer = i2c_linux_xfer,
+        .submit = i2c_linux_submit,
+        .flush = i2c_linux_flush,
+        .max_wr_len = 0xFF,
+};
@@ -0,0 +1,235 @@
+/*
+ * i2c_sim.c
+ *
+ * Description: In-memory model of the Tiny RTC bus, see i2c_sim.h.
+ *
+ * DS1307: 64 byte register/RAM space with a wrapping address pointer, the
+ * clock registers follow the host clock while the CH bit is clear.
+ * AT24C32: 4 KB, erased to 0xFF, 16-bit address pointer, page writes roll
+ * over within the 32 byte page like on the real part.
+ *
+ * Created: 2016-05-09
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <string.h>
+#include <time.h>
+#include "../../common.h"
+#include "../i2c_backend.h"
+#include "i2c_sim.h"
+
+#define SIM_RTC_SIZE            64
+#define SIM_EEPROM_SIZE         4096
+#define SIM_EEPROM_PAGE_SIZE    32
+
+static uint8_t sim_rtc[SIM_RTC_SIZE];
+static uint8_t sim_rtc_ptr;
+static time_t sim_rtc_time;
+
+static uint8_t sim_eeprom[I2C_SIM_EEPROMS][SIM_EEPROM_SIZE];
+static uint16_t sim_eeprom_ptr[I2C_SIM_EEPROMS];
+
+static uint8_t sim_wr_error;
+
+static uint8_t bcd_inc(uint8_t *reg, uint8_t mask, uint8_t wrap, uint8_t base)
+{
+        uint8_t val = ((*reg & mask) >> 4) * 10 + (*reg & 0x0F) + 1;
+        uint8_t carry = val >= wrap;
+
+        if (carry)
+                val = base;
+        *reg = (*reg & ~(mask | 0x0F)) | ((val / 10) << 4) | (val % 10);
+        return carry;
+}
+
+/* Advance the clock registers by the host time passed since last access */
+static void sim_rtc_update(void)
+{
+        static const uint8_t mdays[12] = {
+                31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+        };
+        time_t now = time(NULL);
+        uint8_t month, year, days;
+
+        if (sim_rtc[0] & 0x80) {
+                sim_rtc_time = now;
+                return;
+        }
+        for (; sim_rtc_time < now; sim_rtc_time++) {
+                if (!bcd_inc(&sim_rtc[0], 0x70, 60, 0))
+                        continue;
+                if (!bcd_inc(&sim_rtc[1], 0x70, 60, 0))
+                        continue;
+                if (!bcd_inc(&sim_rtc[2], 0x30, 24, 0))
+                        continue;
+                bcd_inc(&sim_rtc[3], 0x00, 8, 1);
+                month = ((sim_rtc[5] >> 4) & 0x1) * 10 + (sim_rtc[5] & 0x0F);
+                year = (sim_rtc[6] >> 4) * 10 + (sim_rtc[6] & 0x0F);
+                days = mdays[(month - 1) % 12];
+                if (month == 2 && (year % 4) == 0)
+                        days++;
+                if (!bcd_inc(&sim_rtc[4], 0x30, days + 1, 1))
+                        continue;
+                if (!bcd_inc(&sim_rtc[5], 0x10, 13, 1))
+                        continue;
+                bcd_inc(&sim_rtc[6], 0xF0, 100, 0);
+        }
+}
+
+static int sim_eeprom_idx(uint8_t cli_addr)
+{
+        if (cli_addr < AT24C32 || cli_addr >= AT24C32 + I2C_SIM_EEPROMS)
+                return -1;
+        return cli_addr - AT24C32;
+}
+
+void i2c_sim_reset(void)
+{
+        memset(sim_rtc, 0, sizeof(sim_rtc));
+        sim_rtc[0] = 0x80;      /* CH set, oscillator stopped */
+        sim_rtc[3] = 0x01;      /* Day 1, 2000-01-01 */
+        sim_rtc[4] = 0x01;
+        sim_rtc[5] = 0x01;
+        sim_rtc_ptr = 0;
+        sim_rtc_time = time(NULL);
+        memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+        memset(sim_eeprom_ptr, 0, sizeof(sim_eeprom_ptr));
+        sim_wr_error = 0;
+}
+
+int i2c_sim_write(uint8_t cli_addr, const uint8_t *dat, uint16_t len)
+{
+        uint16_t addr;
+        int dev = sim_eeprom_idx(cli_addr);
+
+        if (cli_addr == DS1307) {
+                sim_rtc_update();
+                if (len == 0)
+                        return I2C_OP_OK;
+                sim_rtc_ptr = dat[0] % SIM_RTC_SIZE;
+                for (addr = 1; addr < len; addr++) {
+                        if (sim_rtc_ptr < 7)
+                                sim_rtc_time = time(NULL);
+                        sim_rtc[sim_rtc_ptr] = dat[addr];
+                        sim_rtc_ptr = (sim_rtc_ptr + 1) % SIM_RTC_SIZE;
+                }
+                return I2C_OP_OK;
+        }
+        if (dev < 0)
+                return I2C_OP_ADDR_NACK;
+        if (len < 2)
+                return I2C_OP_OK;
+
+        addr = ((dat[0] << 8) | dat[1]) % SIM_EEPROM_SIZE;
+        sim_eeprom_ptr[dev] = addr;
+        for (dat += 2, len -= 2; len; dat++, len--) {
+                sim_eeprom[dev][sim_eeprom_ptr[dev]] = *dat;
+                /* Page write rolls over within the page */
+                sim_eeprom_ptr[dev] = (sim_eeprom_ptr[dev] &
+                                        ~(SIM_EEPROM_PAGE_SIZE - 1)) |
+                                ((sim_eeprom_ptr[dev] + 1) &
+                                        (SIM_EEPROM_PAGE_SIZE - 1));
+        }
+        return I2C_OP_OK;
+}
+
+int i2c_sim_read(uint8_t cli_addr, uint8_t *dat, uint16_t len)
+{
+        int dev = sim_eeprom_idx(cli_addr);
+
+        if (cli_addr == DS1307) {
+                sim_rtc_update();
+                for (; len; len--) {
+                        *dat++ = sim_rtc[sim_rtc_ptr];
+                        sim_rtc_ptr = (sim_rtc_ptr + 1) % SIM_RTC_SIZE;
+                }
+                return I2C_OP_OK;
+        }
+        if (dev < 0)
+                return I2C_OP_ADDR_NACK;
+        for (; len; len--) {
+                *dat++ = sim_eeprom[dev][sim_eeprom_ptr[dev]];
+                sim_eeprom_ptr[dev] = (sim_eeprom_ptr[dev] + 1) %
+                                                        SIM_EEPROM_SIZE;
+        }
+        return I2C_OP_OK;
+}
+
+uint8_t *i2c_sim_eeprom(uint8_t idx)
+{
+        if (idx >= I2C_SIM_EEPROMS)
+                return NULL;
+        return sim_eeprom[idx];
+}
+
+uint8_t *i2c_sim_rtc(void)
+{
+        sim_rtc_update();
+        return sim_rtc;
+}
+
+static void sim_init(void)
+{
+        i2c_sim_reset();
+}
+
+static void sim_set_clk(unsigned long f_cpu, uint32_t frequency)
+{
+        (void)f_cpu;
+        (void)frequency;
+}
+
+static int sim_xfer(struct i2c_op *ops, uint8_t nbr_ops)
+{
+        uint8_t i;
+        int ret;
+
+        for (i = 0; i < nbr_ops; i++)
+                ops[i].status = I2C_OP_PENDING;
+        for (i = 0; i < nbr_ops; i++) {
+                ret = I2C_OP_OK;
+                if (ops[i].wr_len || !ops[i].rd_len)
+                        ret = i2c_sim_write(ops[i].cli_addr,
+                                                ops[i].wr_dat, ops[i].wr_len);
+                if (ret == I2C_OP_OK && ops[i].rd_len)
+                        ret = i2c_sim_read(ops[i].cli_addr,
+                                                ops[i].rd_dat, ops[i].rd_len);
+                ops[i].status = ret;
+                if (ret != I2C_OP_OK)
+                        return -1;
+        }
+        return 0;
+}
+
+static int sim_submit(uint8_t cli_addr, const uint8_t *hdr, uint8_t hdr_len,
+                                        const uint8_t *dat, uint8_t len)
+{
+        uint8_t buf[2 * 0xFF];
+        int ret;
+
+        if (hdr_len)
+                memcpy(buf, hdr, hdr_len);
+        if (len)
+                memcpy(&buf[hdr_len], dat, len);
+        ret = i2c_sim_write(cli_addr, buf, hdr_len + len);
+        if (ret != I2C_OP_OK && sim_wr_error == 0)
+                sim_wr_error = ret;
+        return 0;
+}
+
+static int sim_flush(void)
+{
+        int err = sim_wr_error;
+
+        sim_wr_error = 0;
+        return err;
+}
+
+const struct i2c_backend i2c_sim_backend = {
+        .init = sim_init,
+        .set_clk = sim_set_clk,
+        .xfer = sim_xfer,
+        .submit = sim_submit,
+        .flush = sim_flush,
+        .max_wr_len = 0xFF,
+};
@@ -0,0 +1,29 @@
+/*
+ * i2c_sim.h
+ *
+ * Description: In-memory model of the Tiny RTC bus (DS1307 + AT24C32s),
+ * used as i2c backend in host builds (I2C_BACKEND_SIM) and by the host
+ * tools to replay and compare bus traffic.
+ *
+ * Created: 2016-05-09
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef I2C_SIM_H_
+#define I2C_SIM_H_
+
+#include <stdint.h>
+
+/* Number of AT24C32s modelled, at AT24C32, AT24C32 + 1, .. */
+#ifndef I2C_SIM_EEPROMS
+#define I2C_SIM_EEPROMS         1
+#endif
+
+void i2c_sim_reset(void);
+int i2c_sim_write(uint8_t cli_addr, const uint8_t *dat, uint16_t len);
+int i2c_sim_read(uint8_t cli_addr, uint8_t *dat, uint16_t len);
+uint8_t *i2c_sim_eeprom(uint8_t idx);
+uint8_t *i2c_sim_rtc(void);
+
+#endif /* I2C_SIM_H_ */
@@ -0,0 +1,262 @@
+/*
+ * i2c_soft.c
+ *
+ * Created: 2016-06-06
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stddef.h>
+#include <avr/io.h>
+#include "../../common.h"
+#include "../../clock/clock.h"
+#include "../i2c_backend.h"
+#include "i2c_soft.h"
+
+#define SOFT_STRETCH_TICKS      ((uint16_t)(I2C_SOFT_STRETCH_US * \
+                                                (CLOCK_HZ / 1000000UL)))
+#define SOFT_READ               (uint8_t)0x01
+
+static uint16_t soft_half;      /* Half SCL period in clock ticks */
+static uint8_t soft_wr_error;
+
+#define soft_sda_low()          (I2C_SOFT_DDR |= (1 << I2C_SOFT_SDA))
+#define soft_sda_release()      (I2C_SOFT_DDR &= ~(1 << I2C_SOFT_SDA))
+#define soft_scl_low()          (I2C_SOFT_DDR |= (1 << I2C_SOFT_SCL))
+#define soft_sda_read()         (I2C_SOFT_PIN & (1 << I2C_SOFT_SDA))
+#define soft_scl_read()         (I2C_SOFT_PIN & (1 << I2C_SOFT_SCL))
+
+static void soft_delay(void)
+{
+        uint16_t t = clock_now();
+
+        while ((uint16_t)(clock_now() - t) < soft_half)
+                ;
+}
+
+/* Releases SCL and waits for it to go high, the client may stretch it */
+static int soft_scl_release(void)
+{
+        uint16_t t;
+
+        I2C_SOFT_DDR &= ~(1 << I2C_SOFT_SCL);
+        if (soft_scl_read())
+                return 0;
+        t = clock_now();
+        while (!soft_scl_read()) {
+                if ((uint16_t)(clock_now() - t) > SOFT_STRETCH_TICKS)
+                        return -1;
+        }
+        return 0;
+}
+
+/* START, or repeated START with SCL low */
+static int soft_start(void)
+{
+        soft_sda_release();
+        soft_delay();
+        if (soft_scl_release())
+                return -1;
+        soft_delay();
+        if (!soft_sda_read())
+                return -1;
+        soft_sda_low();
+        soft_delay();
+        soft_scl_low();
+        return 0;
+}
+
+static void soft_stop(void)
+{
+        soft_sda_low();
+        soft_delay();
+        soft_scl_release();
+        soft_delay();
+        soft_sda_release();
+        soft_delay();
+}
+
+/* Clocks out a byte, returns I2C_OP_OK on ACK, I2C_OP_DATA_NACK on NACK or
+ * I2C_OP_BUS_ERR if SDA or SCL is held low.
+ */
+static uint8_t soft_write(uint8_t dat)
+{
+        uint8_t i, nack;
+
+        for (i = 0; i < 8; i++, dat <<= 1) {
+                if (dat & 0x80)
+                        soft_sda_release();
+                else
+                        soft_sda_low();
+                soft_delay();
+                if (soft_scl_release())
+                        return I2C_OP_BUS_ERR;
+                if ((dat & 0x80) && !soft_sda_read())
+                        return I2C_OP_BUS_ERR;
+                soft_delay();
+                soft_scl_low();
+        }
+        soft_sda_release();
+        soft_delay();
+        if (soft_scl_release())
+                return I2C_OP_BUS_ERR;
+        nack = soft_sda_read();
+        soft_delay();
+        soft_scl_low();
+        return nack ? I2C_OP_DATA_NACK : I2C_OP_OK;
+}
+
+static int soft_read(uint8_t *dat, uint8_t ack)
+{
+        uint8_t i, b = 0;
+
+        soft_sda_release();
+        for (i = 0; i < 8; i++) {
+                soft_delay();
+                if (soft_scl_release())
+                        return -1;
+                b <<= 1;
+                if (soft_sda_read())
+                        b |= 1;
+                soft_delay();
+                soft_scl_low();
+        }
+        if (ack)
+                soft_sda_low();
+        soft_delay();
+        if (soft_scl_release())
+                return -1;
+        soft_delay();
+        soft_scl_low();
+        soft_sda_release();
+        *dat = b;
+        return 0;
+}
+
+/* START (or Sr) and the client address, I2C_OP_xxx status */
+static uint8_t soft_address(uint8_t cli_addr, uint8_t rd)
+{
+        uint8_t ret;
+
+        if (soft_start())
+                return I2C_OP_BUS_ERR;
+        ret = soft_write((cli_addr << 1) | rd);
+        return ret == I2C_OP_DATA_NACK ? I2C_OP_ADDR_NACK : ret;
+}
+
+static uint8_t soft_op(struct i2c_op *op)
+{
+        uint8_t i, ret;
+
+        if (op->wr_len || !op->rd_len) {
+                ret = soft_address(op->cli_addr, 0);
+                for (i = 0; ret == I2C_OP_OK && i < op->wr_len; i++)
+                        ret = soft_write(op->wr_dat[i]);
+                if (ret != I2C_OP_OK)
+                        return ret;
+        }
+        if (op->rd_len) {
+                ret = soft_address(op->cli_addr, SOFT_READ);
+                if (ret != I2C_OP_OK)
+                        return ret;
+                for (i = 0; i < op->rd_len; i++) {
+                        if (soft_read(&op->rd_dat[i], i < op->rd_len - 1))
+                                return I2C_OP_BUS_ERR;
+                }
+        }
+        return I2C_OP_OK;
+}
+
+/* Frees a bus left with SDA low by a client interrupted mid-byte (e.g.
+ * by a reset), clocking it until it releases SDA.
+ */
+static void soft_recover(void)
+{
+        uint8_t i;
+
+        for (i = 0; i < 9 && !soft_sda_read(); i++) {
+                soft_scl_low();
+                soft_delay();
+                soft_scl_release();
+                soft_delay();
+        }
+        soft_scl_low();
+        soft_delay();
+        soft_stop();
+}
+
+static void soft_set_clk(unsigned long f_cpu, uint32_t frequency)
+{
+        soft_half = (f_cpu / CLOCK_PRESCALE) / (2 * frequency);
+        if (!soft_half)
+                soft_half = 1;
+}
+
+static void soft_init(void)
+{
+        I2C_SOFT_PORT &= ~((1 << I2C_SOFT_SDA) | (1 << I2C_SOFT_SCL));
+        I2C_SOFT_DDR &= ~((1 << I2C_SOFT_SDA) | (1 << I2C_SOFT_SCL));
+        soft_set_clk(F_CPU, I2C_SOFT_FREQ);
+        if (!soft_sda_read())
+                soft_recover();
+}
+
+static int soft_xfer(struct i2c_op *ops, uint8_t nbr_ops)
+{
+        uint8_t i;
+
+        for (i = 0; i < nbr_ops; i++)
+                ops[i].status = I2C_OP_PENDING;
+        for (i = 0; i < nbr_ops; i++) {
+                ops[i].status = soft_op(&ops[i]);
+                if (ops[i].status != I2C_OP_OK) {
+                        soft_stop();
+                        return -1;
+                }
+                /* Sr into the next op unless a STOP is requested */
+                if (i == nbr_ops - 1 || (ops[i].flags & I2C_OP_STOP))
+                        soft_stop();
+        }
+        return 0;
+}
+
+/* Runs the write right away, ACK-polling a busy client. The error is kept
+ * for soft_flush() as for the queued TWI writes.
+ */
+static int soft_submit(uint8_t cli_addr, const uint8_t *hdr, uint8_t hdr_len,
+                                        const uint8_t *dat, uint8_t len)
+{
+        uint8_t i, polls, ret;
+
+        for (polls = 0; polls < I2C_SOFT_ACK_POLLS; polls++) {
+                ret = soft_address(cli_addr, 0);
+                if (ret != I2C_OP_ADDR_NACK)
+                        break;
+                soft_stop();
+        }
+        for (i = 0; ret == I2C_OP_OK && i < hdr_len; i++)
+                ret = soft_write(hdr[i]);
+        for (i = 0; ret == I2C_OP_OK && i < len; i++)
+                ret = soft_write(dat[i]);
+        soft_stop();
+
+        if (ret != I2C_OP_OK && soft_wr_error == 0)
+                soft_wr_error = ret;
+        return 0;
+}
+
+static int soft_flush(void)
+{
+        int err = soft_wr_error;
+
+        soft_wr_error = 0;
+        return err;
+}
+
+const struct i2c_backend i2c_soft_backend = {
+        .init = soft_init,
+        .set_clk = soft_set_clk,
+        .xfer = soft_xfer,
+        .submit = soft_submit,
+        .flush = soft_flush,
+        .max_wr_len = 0xFF,
+};
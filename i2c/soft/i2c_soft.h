@@ -0,0 +1,36 @@
+/*
+ * i2c_soft.h
+ *
+ * Description: Bit-banged I2C master on two GPIOs, paced by the Timer1
+ * clock (clock/clock.h). It implements the i2c backend interface
+ * (i2c_backend.h) and carries the traffic of the client at I2C_SOFT_ADDR
+ * (common.h), so e.g. the RTC can be read while the TWI is busy with an
+ * EEPROM write. Both lines are open-drain, driven low through DDR with
+ * PORT cleared and released to the board pull-ups.
+ *
+ * Clients stretching SCL are waited for up to I2C_SOFT_STRETCH_US. The
+ * transfers are run by the CPU, with interrupts enabled, so an ISR only
+ * stretches the bus.
+ *
+ * Created: 2016-06-06
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef I2C_SOFT_H_
+#define I2C_SOFT_H_
+
+#include <avr/io.h>
+
+#define I2C_SOFT_DDR            DDRA
+#define I2C_SOFT_PORT           PORTA
+#define I2C_SOFT_PIN            PINA
+#define I2C_SOFT_SDA            PA0
+#define I2C_SOFT_SCL            PA1
+
+#define I2C_SOFT_FREQ           100000UL
+#define I2C_SOFT_STRETCH_US     10000
+/* Address retries of a queued write while the client is busy */
+#define I2C_SOFT_ACK_POLLS      100
+
+#endif /* I2C_SOFT_H_ */
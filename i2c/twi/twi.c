@@ -36,29 +36,56 @@
 #define sbi(sfr, bit) (_SFR_BYTE(sfr) |= _BV(bit))
 #endif
 
+#include "../../common.h"
 #include "twi.h"
+#include "twi_trace.h"
+#include "../i2c.h"
+#include "../../profile/profile.h"
+
+#ifdef TWI_MASTER_ONLY
+#define TWI_EA 0			// never ack our own slave address
+#else
+#define TWI_EA _BV(TWEA)
+#endif
 
 static volatile uint8_t twi_state;
 static volatile uint8_t twi_slarw;
 static volatile uint8_t twi_sendStop;			// should the transaction end with a stop
 static volatile uint8_t twi_inRepStart;			// in the middle of a repeated start
 
+#ifndef TWI_MASTER_ONLY
 static void (*twi_onSlaveTransmit)(void);
 static void (*twi_onSlaveReceive)(uint8_t*, int);
+#endif
 
-static uint8_t twi_masterBuffer[TWI_BUFFER_LENGTH];
+static uint8_t twi_masterBuffer[TWI_MASTER_BUFFERS][TWI_BUFFER_LENGTH];
+static uint8_t* volatile twi_masterData;		// buffer currently on the wire
 static volatile uint8_t twi_masterBufferIndex;
 static volatile uint8_t twi_masterBufferLength;
 
-static uint8_t twi_txBuffer[TWI_BUFFER_LENGTH];
+#ifndef TWI_MASTER_ONLY
+static uint8_t twi_txBuffer[TWI_SLAVE_BUFFER_LENGTH];
+static const uint8_t* volatile twi_txData;		// data being transmitted as slave
 static volatile uint8_t twi_txBufferIndex;
 static volatile uint8_t twi_txBufferLength;
 
-static uint8_t twi_rxBuffer[TWI_BUFFER_LENGTH];
+static uint8_t twi_rxBuffer[TWI_SLAVE_BUFFER_LENGTH];
 static volatile uint8_t twi_rxBufferIndex;
+#endif
 
 static volatile uint8_t twi_error;
 
+static uint8_t twi_queueSlarw[TWI_MASTER_BUFFERS];	// queued writes, see twi_submit
+static uint8_t twi_queueLength[TWI_MASTER_BUFFERS];
+static volatile uint8_t twi_queueHead;			// staging buffer on the wire
+static volatile uint8_t twi_queueCount;			// queued writes incl. the one on the wire
+static volatile uint16_t twi_ackPolls;			// SLA+W and arbitration retries left for queued write
+static volatile uint8_t twi_queueStarted;		// head of the queue was started by twi_submit
+static volatile uint8_t twi_queueError;			// first error of queued writes since twi_flush
+
+static struct i2c_op* volatile twi_batchOp;		// batch op currently on the wire
+static volatile uint8_t twi_batchLeft;			// ops left in batch, 0 if no batch
+
 #define SDA             PD1
 #define SCL             PD0
 
@@ -76,6 +103,10 @@ void twi_init(unsigned long f_cpu)
   twi_state = TWI_READY;
   twi_sendStop = true;		// default value
   twi_inRepStart = false;
+  twi_queueHead = 0;
+  twi_queueCount = 0;
+  twi_queueStarted = false;
+  twi_queueError = 0xFF;
   
   /* Activate internal pull-ups for twi SDA & SCL pins by
    * setting them to inputs and then set their output high.
@@ -96,7 +127,7 @@ void twi_init(unsigned long f_cpu)
   It is 72 for a 16mhz Wiring board with 100kHz TWI */
 
   // enable twi module, acks, and twi interrupt
-  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA);
+  TWCR = _BV(TWEN) | _BV(TWIE) | TWI_EA;
 }
 
 /* 
@@ -121,6 +152,7 @@ void twi_disable(void)
   PORTD = PORTD_shadow & ~(1 << PD0 | 1 << PD1);
 }
 
+#ifndef TWI_MASTER_ONLY
 /* 
  * Function twi_slaveInit
  * Desc     sets slave address and enables interrupt
@@ -132,6 +164,7 @@ void twi_setAddress(uint8_t address)
   // set twi slave address (skip over TWGCE bit)
   TWAR = address << 1;
 }
+#endif
 
 /* 
  * Function twi_readFrom
@@ -162,6 +195,7 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
   twi_error = 0xFF;
 
   // initialize buffer iteration vars
+  twi_masterData = twi_masterBuffer[twi_queueHead];
   twi_masterBufferIndex = 0;
   twi_masterBufferLength = length-1;  // This is not intuitive, read on...
   // On receive, the previously configured ACK/NACK setting is transmitted in
@@ -185,11 +219,11 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
     do {
       TWDR = twi_slarw;
     } while(TWCR & _BV(TWWC));
-    TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE);	// enable INTs, but not START
+    TWCR = _BV(TWINT) | TWI_EA | _BV(TWEN) | _BV(TWIE);	// enable INTs, but not START
   }
   else
     // send start condition
-    TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);
+    TWCR = _BV(TWEN) | _BV(TWIE) | TWI_EA | _BV(TWINT) | _BV(TWSTA);
 
   // wait for read operation to complete
   while(TWI_MRX == twi_state){
@@ -201,7 +235,7 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
 
   // copy twi buffer to data
   for(i = 0; i < length; ++i){
-    data[i] = twi_masterBuffer[i];
+    data[i] = twi_masterData[i];
   }
 	
   return length;
@@ -214,7 +248,8 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
  * Input    address: 7bit i2c device address
  *          data: pointer to byte array
  *          length: number of bytes in array
- *          wait: boolean indicating to wait for write or not
+ *          wait: boolean indicating to wait for write or not, a write that
+ *                doesn't wait and ends with a stop is queued by twi_submit
  *          sendStop: boolean indicating whether or not to send a stop at the end
  * Output   0 .. success
  *          1 .. length to long for buffer
@@ -231,6 +266,10 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
     return 1;
   }
 
+  if(!wait && sendStop && !twi_inRepStart){
+    return twi_submit(address, data, length, NULL, 0);
+  }
+
   // wait until twi is ready, become master transmitter
   while(TWI_READY != twi_state){
     continue;
@@ -241,12 +280,13 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
   twi_error = 0xFF;
 
   // initialize buffer iteration vars
+  twi_masterData = twi_masterBuffer[twi_queueHead];
   twi_masterBufferIndex = 0;
   twi_masterBufferLength = length;
   
   // copy data to twi buffer
   for(i = 0; i < length; ++i){
-    twi_masterBuffer[i] = data[i];
+    twi_masterData[i] = data[i];
   }
   
   // build sla+w, slave device address + w bit
@@ -267,11 +307,11 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
     do {
       TWDR = twi_slarw;				
     } while(TWCR & _BV(TWWC));
-    TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE);	// enable INTs, but not START
+    TWCR = _BV(TWINT) | TWI_EA | _BV(TWEN) | _BV(TWIE);	// enable INTs, but not START
   }
   else
     // send start condition
-    TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);	// enable INTs
+    TWCR = _BV(TWINT) | TWI_EA | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);	// enable INTs
 
   // wait for write operation to complete
   while(wait && (TWI_MTX == twi_state)){
@@ -288,6 +328,318 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
     return 4;	// other twi error
 }
 
+/* 
+ * Function twi_queueLoad
+ * Desc     loads the queued write at the head of the queue into the
+ *          master state, the caller issues the START. The retries left
+ *          are kept, a new write sets them before
+ * Input    none
+ * Output   none
+ */
+static void twi_queueLoad(void)
+{
+  uint8_t slot = twi_queueHead;
+
+  twi_state = TWI_MTX;
+  twi_sendStop = true;
+  twi_error = 0xFF;
+  twi_slarw = twi_queueSlarw[slot];
+  twi_masterData = twi_masterBuffer[slot];
+  twi_masterBufferIndex = 0;
+  twi_masterBufferLength = twi_queueLength[slot];
+}
+
+/* 
+ * Function twi_queueNext
+ * Desc     called from the ISR when the queued write on the wire is done
+ *          (or failed), frees its staging buffer and either chains the
+ *          next queued write with a STOP+START or ends with a STOP
+ * Input    none
+ * Output   none
+ */
+static void twi_queueNext(void)
+{
+  if(0xFF != twi_error && 0xFF == twi_queueError){
+    twi_queueError = twi_error;
+  }
+  twi_queueHead = (twi_queueHead + 1) % TWI_MASTER_BUFFERS;
+  if(0 == --twi_queueCount){
+    twi_queueStarted = false;
+    twi_stop();
+    return;
+  }
+  twi_ackPolls = TWI_ACK_POLLS;
+  twi_queueLoad();
+  TWI_TRACE_REC(TWI_TRACE_STOP, 0);
+  TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWSTO) | _BV(TWEN) | _BV(TWIE) | TWI_EA;
+}
+
+/* 
+ * Function twi_slaveDone
+ * Desc     called from the ISR at the end of a slave transfer. A queued
+ *          write that was pre-empted (arbitration lost to the master
+ *          addressing us, or its START pending while we were addressed)
+ *          is started again once the bus is free with the retries it
+ *          has left, otherwise the bus is released
+ * Input    none
+ * Output   none
+ */
+#ifndef TWI_MASTER_ONLY
+static void twi_slaveDone(void)
+{
+  if(twi_queueStarted){
+    twi_queueLoad();
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) | TWI_EA;
+  }else{
+    twi_releaseBus();
+  }
+}
+#endif
+
+/* 
+ * Function twi_submit
+ * Desc     queues a write without waiting for the bus. The data is copied
+ *          into a free staging buffer, so the caller can prepare the next
+ *          write while this one is on the wire; the ISR starts queued
+ *          writes back-to-back. A queued write NACKed on its address is
+ *          retried (ACK polling), so consecutive EEPROM page writes can
+ *          be queued without waiting out the write cycle in between. A
+ *          write that loses arbitration is sent again from its start once
+ *          the bus is free, sharing the same retry budget.
+ *          Errors are collected and returned by twi_flush.
+ * Input    address: 7bit i2c device address
+ *          hdr: bytes to send first (e.g. register address), may be NULL
+ *          hdrLength: number of bytes in hdr
+ *          data: pointer to byte array
+ *          length: number of bytes in array
+ * Output   0 .. queued
+ *          1 .. length to long for buffer
+ */
+uint8_t twi_submit(uint8_t address, const uint8_t* hdr, uint8_t hdrLength, const uint8_t* data, uint8_t length)
+{
+  uint8_t sreg;
+  uint8_t slot;
+  uint8_t start;
+  uint8_t* buf;
+  uint8_t i;
+
+  // ensure data will fit into buffer
+  if(TWI_BUFFER_LENGTH < hdrLength + length){
+    return 1;
+  }
+
+  // wait for a free staging buffer
+  while(TWI_MASTER_BUFFERS == twi_queueCount){
+    continue;
+  }
+  // the tail slot is not on the wire and the ISR doesn't move it
+  sreg = SREG;
+  cli();
+  slot = (twi_queueHead + twi_queueCount) % TWI_MASTER_BUFFERS;
+  SREG = sreg;
+
+  buf = twi_masterBuffer[slot];
+  for(i = 0; i < hdrLength; ++i){
+    *buf++ = hdr[i];
+  }
+  for(i = 0; i < length; ++i){
+    *buf++ = data[i];
+  }
+  twi_queueSlarw[slot] = TW_WRITE | (address << 1);
+  twi_queueLength[slot] = hdrLength + length;
+
+  sreg = SREG;
+  cli();
+  start = (0 == twi_queueCount++);
+  SREG = sreg;
+
+  if(start){
+    // queue was idle, wait until twi is ready, become master transmitter;
+    // checked with interrupts off so a slave address can't slip in between
+    while(true){
+      sreg = SREG;
+      cli();
+      if(TWI_READY == twi_state){
+        break;
+      }
+      SREG = sreg;
+    }
+    twi_ackPolls = TWI_ACK_POLLS;
+    twi_queueLoad();
+    twi_queueStarted = true;
+    TWCR = _BV(TWINT) | TWI_EA | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);
+    SREG = sreg;
+  }
+  return 0;
+}
+
+/* 
+ * Function twi_flush
+ * Desc     waits until all queued writes are done
+ * Output   0 .. success
+ *          2 .. address send, NACK received
+ *          3 .. data send, NACK received
+ *          4 .. other twi error (arbitration lost on every retry, bus
+ *               error, ..)
+ *          (first error of any queued write since the last flush)
+ */
+uint8_t twi_flush(void)
+{
+  uint8_t error;
+
+  while(twi_queueCount){
+    continue;
+  }
+  error = twi_queueError;
+  twi_queueError = 0xFF;
+
+  if (error == 0xFF)
+    return 0;	// success
+  else if (error == TW_MT_SLA_NACK)
+    return 2;	// error: address send, nack received
+  else if (error == TW_MT_DATA_NACK)
+    return 3;	// error: data send, nack received
+  else
+    return 4;	// other twi error
+}
+
+/* 
+ * Function twi_batchSetup
+ * Desc     loads the first phase of a batch op into the master state,
+ *          a write phase if there is data to write (or nothing to read,
+ *          i.e. an address probe), else a read phase
+ * Input    op: batch op to load
+ * Output   none
+ */
+static void twi_batchSetup(struct i2c_op* op)
+{
+  twi_masterBufferIndex = 0;
+  if(op->wr_len || !op->rd_len){
+    twi_state = TWI_MTX;
+    twi_slarw = TW_WRITE | (op->cli_addr << 1);
+    twi_masterData = op->wr_dat;
+    twi_masterBufferLength = op->wr_len;
+  }else{
+    twi_state = TWI_MRX;
+    twi_slarw = TW_READ | (op->cli_addr << 1);
+    twi_masterData = op->rd_dat;
+    twi_masterBufferLength = op->rd_len-1;	// see twi_readFrom
+  }
+}
+
+/* 
+ * Function twi_batchNext
+ * Desc     called from the ISR when a batch phase completed successfully,
+ *          chains the next phase/op onto the bus without involving the
+ *          caller: a repeated START into the read phase of the same op,
+ *          a repeated START (or STOP+START if I2C_OP_STOP) into the next
+ *          op, or a STOP when the batch is done
+ * Input    none
+ * Output   none
+ */
+static void twi_batchNext(void)
+{
+  struct i2c_op* op = twi_batchOp;
+
+  if(TWI_MTX == twi_state && op->rd_len){
+    // write phase done, turn around into the read phase of the same op
+    twi_state = TWI_MRX;
+    twi_slarw = TW_READ | (op->cli_addr << 1);
+    twi_masterData = op->rd_dat;
+    twi_masterBufferIndex = 0;
+    twi_masterBufferLength = op->rd_len-1;
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE);
+    return;
+  }
+
+  op->status = I2C_OP_OK;
+  if(0 == --twi_batchLeft){
+    twi_stop();
+    return;
+  }
+
+  twi_batchOp = op + 1;
+  twi_batchSetup(op + 1);
+  if(op->flags & I2C_OP_STOP){
+    // STOP followed by START, e.g. to let an EEPROM commit a page write
+    TWI_TRACE_REC(TWI_TRACE_STOP, 0);
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWSTO) | _BV(TWEN) | _BV(TWIE) | TWI_EA;
+  }else{
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE);
+  }
+}
+
+/* 
+ * Function twi_batch
+ * Desc     attempts to become twi bus master and run a list of write,
+ *          read and write-then-read ops back-to-back from the ISR, using
+ *          repeated STARTs between ops. Data is transferred directly
+ *          from/to the op buffers, so lengths are not limited by the
+ *          twi buffer. Each op's status is set to I2C_OP_OK when done,
+ *          the failing op gets its error status and the rest of the
+ *          batch is left I2C_OP_PENDING.
+ * Input    ops: array of ops
+ *          count: number of ops in array
+ * Output   0 .. success
+ *          2 .. address send, NACK received
+ *          3 .. data send, NACK received
+ *          4 .. other twi error (lost bus arbitration, bus error, ..)
+ */
+uint8_t twi_batch(struct i2c_op* ops, uint8_t count)
+{
+  struct i2c_op* op;
+  uint8_t i;
+
+  if(0 == count){
+    return 0;
+  }
+  for(i = 0; i < count; ++i){
+    ops[i].status = I2C_OP_PENDING;
+  }
+
+  // wait until twi is ready, become master
+  while(TWI_READY != twi_state){
+    continue;
+  }
+  // reset error state (0xFF.. no error occured)
+  twi_error = 0xFF;
+  twi_sendStop = true;
+  twi_batchOp = ops;
+  twi_batchLeft = count;
+  twi_batchSetup(ops);
+
+  if (true == twi_inRepStart) {
+    // see twi_readFrom, the START has already been sent
+    twi_inRepStart = false;
+    do {
+      TWDR = twi_slarw;
+    } while(TWCR & _BV(TWWC));
+    TWCR = _BV(TWINT) | TWI_EA | _BV(TWEN) | _BV(TWIE);	// enable INTs, but not START
+  }
+  else
+    // send start condition
+    TWCR = _BV(TWINT) | TWI_EA | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);
+
+  // wait for the whole batch to complete
+  while(TWI_READY != twi_state){
+    continue;
+  }
+  twi_batchLeft = 0;
+
+  if (twi_error == 0xFF)
+    return 0;	// success
+
+  op = twi_batchOp;
+  if (twi_error == TW_MT_SLA_NACK || twi_error == TW_MR_SLA_NACK)
+    op->status = I2C_OP_ADDR_NACK;
+  else if (twi_error == TW_MT_DATA_NACK)
+    op->status = I2C_OP_DATA_NACK;
+  else
+    op->status = I2C_OP_BUS_ERR;
+  return op->status;
+}
+
+#ifndef TWI_MASTER_ONLY
 /* 
  * Function twi_transmit
  * Desc     fills slave tx buffer with data
@@ -303,7 +655,7 @@ uint8_t twi_transmit(const uint8_t* data, uint8_t length)
   uint8_t i;
 
   // ensure data will fit into buffer
-  if(TWI_BUFFER_LENGTH < length){
+  if(TWI_SLAVE_BUFFER_LENGTH < length){
     return 1;
   }
   
@@ -321,6 +673,29 @@ uint8_t twi_transmit(const uint8_t* data, uint8_t length)
   return 0;
 }
 
+/* 
+ * Function twi_transmitDirect
+ * Desc     hands the slave transmitter a pointer to the data to send
+ *          instead of copying it into the tx buffer (zero-copy reply),
+ *          the data must stay valid until the master ends the read
+ *          must be called in slave tx event callback
+ * Input    data: pointer to byte array
+ *          length: number of bytes in array
+ * Output   2 not slave transmitter
+ *          0 ok
+ */
+uint8_t twi_transmitDirect(const uint8_t* data, uint8_t length)
+{
+  // ensure we are currently a slave transmitter
+  if(TWI_STX != twi_state){
+    return 2;
+  }
+
+  twi_txData = data;
+  twi_txBufferLength = length;
+  return 0;
+}
+
 /* 
  * Function twi_attachSlaveRxEvent
  * Desc     sets function called before a slave read operation
@@ -342,6 +717,7 @@ void twi_attachSlaveTxEvent( void (*function)(void) )
 {
   twi_onSlaveTransmit = function;
 }
+#endif
 
 /* 
  * Function twi_reply
@@ -367,8 +743,10 @@ void twi_reply(uint8_t ack)
  */
 void twi_stop(void)
 {
+  TWI_TRACE_REC(TWI_TRACE_STOP, 0);
+
   // send stop condition
-  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTO);
+  TWCR = _BV(TWEN) | _BV(TWIE) | TWI_EA | _BV(TWINT) | _BV(TWSTO);
 
   // wait for stop condition to be exectued on bus
   // TWINT is not set after a stop condition!
@@ -389,7 +767,7 @@ void twi_stop(void)
 void twi_releaseBus(void)
 {
   // release bus
-  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT);
+  TWCR = _BV(TWEN) | _BV(TWIE) | TWI_EA | _BV(TWINT);
 
   // update twi state
   twi_state = TWI_READY;
@@ -397,6 +775,9 @@ void twi_releaseBus(void)
 
 ISR(TWI_vect)
 {
+  PROFILE_ENTER();
+  TWI_TRACE_REC(TW_STATUS, TWDR);
+
   switch(TW_STATUS){
     // All Master
     case TW_START:     // sent start condition
@@ -412,10 +793,14 @@ ISR(TWI_vect)
       // if there is data to send, send it, otherwise stop 
       if(twi_masterBufferIndex < twi_masterBufferLength){
         // copy data to output register and ack
-        TWDR = twi_masterBuffer[twi_masterBufferIndex++];
+        TWDR = twi_masterData[twi_masterBufferIndex++];
         twi_reply(1);
       }else{
-	if (twi_sendStop)
+	if (twi_batchLeft)
+	  twi_batchNext();
+	else if (twi_queueCount)
+	  twi_queueNext();
+	else if (twi_sendStop)
           twi_stop();
 	else {
 	  twi_inRepStart = true;	// we're gonna send the START
@@ -428,22 +813,45 @@ ISR(TWI_vect)
       }
       break;
     case TW_MT_SLA_NACK:  // address sent, nack received
+      if (twi_queueCount && twi_ackPolls) {
+        // queued write to a busy device (EEPROM write cycle), poll it again
+        twi_ackPolls--;
+        TWI_TRACE_REC(TWI_TRACE_STOP, 0);
+        TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWSTO) | _BV(TWEN) | _BV(TWIE) | TWI_EA;
+        break;
+      }
       twi_error = TW_MT_SLA_NACK;
-      twi_stop();
+      if (twi_queueCount)
+        twi_queueNext();
+      else
+        twi_stop();
       break;
     case TW_MT_DATA_NACK: // data sent, nack received
       twi_error = TW_MT_DATA_NACK;
-      twi_stop();
+      if (twi_queueCount)
+        twi_queueNext();
+      else
+        twi_stop();
       break;
     case TW_MT_ARB_LOST: // lost bus arbitration
+      if (twi_queueCount && twi_ackPolls) {
+        // queued write, send it again from the start once the bus is free
+        twi_ackPolls--;
+        twi_masterBufferIndex = 0;
+        TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) | TWI_EA;
+        break;
+      }
       twi_error = TW_MT_ARB_LOST;
-      twi_releaseBus();
+      if (twi_queueCount)
+        twi_queueNext();	// drop it, the next one starts when the bus is free
+      else
+        twi_releaseBus();
       break;
 
     // Master Receiver
     case TW_MR_DATA_ACK: // data received, ack sent
       // put byte into buffer
-      twi_masterBuffer[twi_masterBufferIndex++] = TWDR;
+      twi_masterData[twi_masterBufferIndex++] = TWDR;
     case TW_MR_SLA_ACK:  // address sent, ack received
       // ack if more bytes are expected, otherwise nack
       if(twi_masterBufferIndex < twi_masterBufferLength){
@@ -454,8 +862,10 @@ ISR(TWI_vect)
       break;
     case TW_MR_DATA_NACK: // data received, nack sent
       // put final byte into buffer
-      twi_masterBuffer[twi_masterBufferIndex++] = TWDR;
-	if (twi_sendStop)
+      twi_masterData[twi_masterBufferIndex++] = TWDR;
+	if (twi_batchLeft)
+	  twi_batchNext();
+	else if (twi_sendStop)
           twi_stop();
 	else {
 	  twi_inRepStart = true;	// we're gonna send the START
@@ -467,10 +877,12 @@ ISR(TWI_vect)
 	}    
 	break;
     case TW_MR_SLA_NACK: // address sent, nack received
+      twi_error = TW_MR_SLA_NACK;
       twi_stop();
       break;
     // TW_MR_ARB_LOST handled by TW_MT_ARB_LOST case
 
+#ifndef TWI_MASTER_ONLY
     // Slave Receiver
     case TW_SR_SLA_ACK:   // addressed, returned ack
     case TW_SR_GCALL_ACK: // addressed generally, returned ack
@@ -485,7 +897,7 @@ ISR(TWI_vect)
     case TW_SR_DATA_ACK:       // data received, returned ack
     case TW_SR_GCALL_DATA_ACK: // data received generally, returned ack
       // if there is still room in the rx buffer
-      if(twi_rxBufferIndex < TWI_BUFFER_LENGTH){
+      if(twi_rxBufferIndex < TWI_SLAVE_BUFFER_LENGTH){
         // put byte in buffer and ack
         twi_rxBuffer[twi_rxBufferIndex++] = TWDR;
         twi_reply(1);
@@ -495,14 +907,17 @@ ISR(TWI_vect)
       }
       break;
     case TW_SR_STOP: // stop or repeated start condition received
-      // ack future responses and leave slave receiver state
-      twi_releaseBus();
+      // ack future responses and leave slave receiver state, restart a
+      // pre-empted queued write
+      twi_slaveDone();
       // put a null char after data if there's room
-      if(twi_rxBufferIndex < TWI_BUFFER_LENGTH){
+      if(twi_rxBufferIndex < TWI_SLAVE_BUFFER_LENGTH){
         twi_rxBuffer[twi_rxBufferIndex] = '\0';
       }
       // callback to user defined callback
-      twi_onSlaveReceive(twi_rxBuffer, twi_rxBufferIndex);
+      if(twi_onSlaveReceive){
+        twi_onSlaveReceive(twi_rxBuffer, twi_rxBufferIndex);
+      }
       // since we submit rx buffer to "wire" library, we can reset it
       twi_rxBufferIndex = 0;
       break;
@@ -520,19 +935,23 @@ ISR(TWI_vect)
       // ready the tx buffer index for iteration
       twi_txBufferIndex = 0;
       // set tx buffer length to be zero, to verify if user changes it
+      twi_txData = twi_txBuffer;
       twi_txBufferLength = 0;
       // request for txBuffer to be filled and length to be set
       // note: user must call twi_transmit(bytes, length) to do this
-      twi_onSlaveTransmit();
+      if(twi_onSlaveTransmit){
+        twi_onSlaveTransmit();
+      }
       // if they didn't change buffer & length, initialize it
       if(0 == twi_txBufferLength){
+        twi_txData = twi_txBuffer;
         twi_txBufferLength = 1;
         twi_txBuffer[0] = 0x00;
       }
       // transmit first byte from buffer, fall
     case TW_ST_DATA_ACK: // byte sent, ack returned
       // copy data to output register
-      TWDR = twi_txBuffer[twi_txBufferIndex++];
+      TWDR = twi_txData[twi_txBufferIndex++];
       // if there is more to send, ack, otherwise nack
       if(twi_txBufferIndex < twi_txBufferLength){
         twi_reply(1);
@@ -542,19 +961,23 @@ ISR(TWI_vect)
       break;
     case TW_ST_DATA_NACK: // received nack, we are done 
     case TW_ST_LAST_DATA: // received ack, but we are done already!
-      // ack future responses
-      twi_reply(1);
-      // leave slave receiver state
-      twi_state = TWI_READY;
+      // ack future responses and leave slave transmitter state, restart
+      // a pre-empted queued write
+      twi_slaveDone();
       break;
+#endif
 
     // All
     case TW_NO_INFO:   // no state information
       break;
     case TW_BUS_ERROR: // bus error, illegal stop/start
       twi_error = TW_BUS_ERROR;
-      twi_stop();
+      if (twi_queueCount)
+        twi_queueNext();
+      else
+        twi_stop();
       break;
   }
+  PROFILE_EXIT(PROFILE_TWI);
 }
 
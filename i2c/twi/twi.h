@@ -27,24 +27,50 @@
   #define TWI_FREQ 100000L
   #endif
 
+  // master buffer size, define TWI_MASTER_ONLY to leave out slave mode
   #ifndef TWI_BUFFER_LENGTH
   #define TWI_BUFFER_LENGTH 256
   #endif
 
+  #ifndef TWI_SLAVE_BUFFER_LENGTH
+  #define TWI_SLAVE_BUFFER_LENGTH TWI_BUFFER_LENGTH
+  #endif
+
+  // staging buffers for queued (non-waiting) master writes, see twi_submit
+  #ifndef TWI_MASTER_BUFFERS
+  #define TWI_MASTER_BUFFERS 2
+  #endif
+
+  // SLA+W and lost arbitration retries of a queued write, covers an EEPROM
+  // write cycle at 400kHz
+  #ifndef TWI_ACK_POLLS
+  #define TWI_ACK_POLLS 400
+  #endif
+
   #define TWI_READY 0
   #define TWI_MRX   1
   #define TWI_MTX   2
   #define TWI_SRX   3
   #define TWI_STX   4
+
+  struct i2c_op;
   
   void twi_init(unsigned long f_cpu);
   void twi_disable(void);
+#ifndef TWI_MASTER_ONLY
   void twi_setAddress(uint8_t);
+#endif
   uint8_t twi_readFrom(uint8_t, uint8_t*, uint8_t, uint8_t);
   uint8_t twi_writeTo(uint8_t, uint8_t*, uint8_t, uint8_t, uint8_t);
+  uint8_t twi_submit(uint8_t, const uint8_t*, uint8_t, const uint8_t*, uint8_t);
+  uint8_t twi_flush(void);
+  uint8_t twi_batch(struct i2c_op*, uint8_t);
+#ifndef TWI_MASTER_ONLY
   uint8_t twi_transmit(const uint8_t*, uint8_t);
+  uint8_t twi_transmitDirect(const uint8_t*, uint8_t);
   void twi_attachSlaveRxEvent( void (*)(uint8_t*, int) );
   void twi_attachSlaveTxEvent( void (*)(void) );
+#endif
   void twi_reply(uint8_t);
   void twi_stop(void);
   void twi_releaseBus(void);
@@ -0,0 +1,66 @@
+/*
+ * twi_trace.c
+ *
+ * Created: 2016-05-23
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <avr/interrupt.h>
+#include "../../common.h"
+#include "twi_trace.h"
+
+#ifdef TWI_TRACE
+
+struct twi_trace_ev twi_trace_buf[TWI_TRACE_LENGTH];
+volatile uint8_t twi_trace_head;
+/* Tuples recorded, modulo 2^16 */
+volatile uint16_t twi_trace_total;
+/* twi_trace_total at the last dump. If more than TWI_TRACE_LENGTH tuples
+ * were recorded since, the ring wrapped and only the newest ones are
+ * printed, the number of lost ones is reported.
+ */
+static uint16_t twi_trace_dumped;
+
+void twi_trace_dump(void)
+{
+        struct twi_trace_ev ev;
+        uint16_t total, count, lost = 0;
+        uint8_t tail;
+
+        cli();
+        total = twi_trace_total;
+        tail = twi_trace_head;
+        sei();
+        count = total - twi_trace_dumped;
+        if (count > TWI_TRACE_LENGTH) {
+                /* Wrapped, the oldest tuple is the one at the head */
+                lost = count - TWI_TRACE_LENGTH;
+                count = TWI_TRACE_LENGTH;
+        } else {
+                tail = (tail - count) & (TWI_TRACE_LENGTH - 1);
+        }
+        twi_trace_dumped = total;
+
+        printf_P(PSTR("TRACE %u lost %u\n"), count, lost);
+        /* Oldest first. Tuples may be overwritten while printing at 9600
+         * baud, so each one is copied with interrupts disabled.
+         */
+        while (count--) {
+                cli();
+                ev = twi_trace_buf[tail];
+                sei();
+                printf_P(PSTR("T %04x %02x %02x\n"), ev.tick, ev.status,
+                                                                ev.data);
+                tail = (tail + 1) & (TWI_TRACE_LENGTH - 1);
+        }
+        printf_P(PSTR("TRACE END\n"));
+}
+
+#else
+
+void twi_trace_dump(void)
+{
+}
+
+#endif /* TWI_TRACE */
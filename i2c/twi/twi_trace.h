@@ -0,0 +1,61 @@
+/*
+ * twi_trace.h
+ *
+ * Description: Optional (TWI_TRACE) bus trace recorder. ISR(TWI_vect)
+ * stores a (timestamp, TWSR status, TWDR) tuple per interrupt in a RAM
+ * ring, plus a TWI_TRACE_STOP tuple per STOP sent. twi_trace_dump() prints
+ * the ring over UART, one "T <tick> <status> <data>" line per tuple (hex),
+ * which tools/twi_replay.c reads back.
+ *
+ * Created: 2016-05-23
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef TWI_TRACE_H_
+#define TWI_TRACE_H_
+
+#include <inttypes.h>
+
+/* Ring length, power of two */
+#ifndef TWI_TRACE_LENGTH
+#define TWI_TRACE_LENGTH        64
+#endif
+
+/* Pseudo status for a STOP, TWSR status codes have the 3 LSBs cleared */
+#define TWI_TRACE_STOP          0x01
+
+struct twi_trace_ev {
+        uint16_t tick;          /* clock_now_isr(), see clock/clock.h */
+        uint8_t status;
+        uint8_t data;
+};
+
+#ifdef TWI_TRACE
+#include <avr/io.h>
+
+extern struct twi_trace_ev twi_trace_buf[TWI_TRACE_LENGTH];
+extern volatile uint8_t twi_trace_head;
+extern volatile uint16_t twi_trace_total;
+
+/* A handful of cycles: 4 stores, a masked index and a count increment */
+static inline void twi_trace_rec(uint8_t status, uint8_t data)
+{
+        uint8_t head = twi_trace_head;
+        struct twi_trace_ev *ev = &twi_trace_buf[head];
+
+        ev->tick = TCNT1;
+        ev->status = status;
+        ev->data = data;
+        twi_trace_head = (head + 1) & (TWI_TRACE_LENGTH - 1);
+        twi_trace_total++;
+}
+
+#define TWI_TRACE_REC(status, data)     twi_trace_rec(status, data)
+#else
+#define TWI_TRACE_REC(status, data)
+#endif
+
+void twi_trace_dump(void);
+
+#endif /* TWI_TRACE_H_ */
@@ -0,0 +1,97 @@
+/*
+ * ring.h
+ *
+ * Description: Single-producer/single-consumer ring indices for data
+ * shared between an ISR and main-line code, without blocking interrupts.
+ * The ring holds len - 1 elements of any type in a caller-owned array, len
+ * a power of two up to 256. Only the producer writes head and only the
+ * consumer writes tail, both single bytes, so each side sees either the old
+ * or the new index of the other and never a torn one.
+ *
+ * Producer:
+ *      if (!ring_full(&r, LEN)) {
+ *              buf[ring_put_idx(&r)] = data;
+ *              ring_put_commit(&r, LEN);
+ *      }
+ * Consumer:
+ *      if (!ring_empty(&r)) {
+ *              data = buf[ring_get_idx(&r)];
+ *              ring_get_commit(&r, LEN);
+ *      }
+ *
+ * Several ISRs can share the producer (or the consumer) side as ISRs do not
+ * nest, main-line code sharing a side with an ISR has to block interrupts
+ * around its access.
+ *
+ * Created: 2016-06-10
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <inttypes.h>
+
+/* Keeps the compiler from moving element accesses past an index update */
+#define RING_BARRIER()  __asm__ __volatile__("" ::: "memory")
+
+struct ring {
+        volatile uint8_t head;  /* Next slot to write, producer only */
+        volatile uint8_t tail;  /* Next slot to read, consumer only */
+};
+
+static inline void ring_init(struct ring *r)
+{
+        r->head = 0;
+        r->tail = 0;
+}
+
+static inline uint8_t ring_count(const struct ring *r, uint16_t len)
+{
+        return (uint8_t)(r->head - r->tail) & (uint8_t)(len - 1);
+}
+
+static inline uint8_t ring_free(const struct ring *r, uint16_t len)
+{
+        return (uint8_t)(r->tail - r->head - 1) & (uint8_t)(len - 1);
+}
+
+static inline uint8_t ring_empty(const struct ring *r)
+{
+        return r->head == r->tail;
+}
+
+static inline uint8_t ring_full(const struct ring *r, uint16_t len)
+{
+        return ((r->head + 1) & (uint8_t)(len - 1)) == r->tail;
+}
+
+/* Slot to fill, valid while the ring is not full */
+static inline uint8_t ring_put_idx(const struct ring *r)
+{
+        return r->head;
+}
+
+/* Publishes the filled slot to the consumer */
+static inline void ring_put_commit(struct ring *r, uint16_t len)
+{
+        RING_BARRIER();
+        r->head = (r->head + 1) & (uint8_t)(len - 1);
+}
+
+/* Oldest slot, valid while the ring is not empty */
+static inline uint8_t ring_get_idx(const struct ring *r)
+{
+        RING_BARRIER();
+        return r->tail;
+}
+
+/* Hands the read slot back to the producer */
+static inline void ring_get_commit(struct ring *r, uint16_t len)
+{
+        RING_BARRIER();
+        r->tail = (r->tail + 1) & (uint8_t)(len - 1);
+}
+
+#endif /* RING_H_ */
@@ -0,0 +1,44 @@
+/*
+ * snap.h
+ *
+ * Description: Consistent reads of multi-byte variables written by an ISR,
+ * from main-line code and without blocking interrupts. The AVR reads them
+ * a byte at a time, so the ISR may update one in between and the bytes
+ * read mix the old and the new value. A read is repeated until two in a
+ * row agree, which holds as long as the ISR does not run twice within one
+ * read, i.e. for any writer slower than a few dozen cycles.
+ *
+ * Writes from main-line code of a variable read by an ISR still need
+ * ATOMIC_BLOCK(), the ISR cannot retry.
+ *
+ * Created: 2016-06-10
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef SNAP_H_
+#define SNAP_H_
+
+#include <inttypes.h>
+
+static inline uint16_t snap_u16(const volatile uint16_t *p)
+{
+        uint16_t val;
+
+        do {
+                val = *p;
+        } while (val != *p);
+        return val;
+}
+
+static inline uint32_t snap_u32(const volatile uint32_t *p)
+{
+        uint32_t val;
+
+        do {
+                val = *p;
+        } while (val != *p);
+        return val;
+}
+
+#endif /* SNAP_H_ */
@@ -0,0 +1,504 @@
+/*
+ * log.c
+ *
+ * Created: 2016-05-30
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <string.h>
+#include "../common.h"
+#include "../crc/crc16.h"
+#include "../eeprom/eeprom.h"
+#include "log.h"
+#ifdef LOG_COMPRESS
+#include "../rtc/rtc.h"
+#include "log_pack.h"
+#endif
+
+#define LOG_IDX_ADDR(page)      (LOG_BASE_PAGE * EEPROM_PAGE_SIZE + \
+                                (page) * LOG_IDX_SIZE)
+#define LOG_PAGE_ADDR(page)     ((LOG_BASE_PAGE + LOG_IDX_PAGES + (page)) * \
+                                EEPROM_PAGE_SIZE)
+/* Page after the data pages, holds the records saved by log_flush() */
+#define LOG_FLUSH_ADDR          LOG_PAGE_ADDR(log_pages)
+#define LOG_SAVE_MAGIC          (uint8_t)0x5A
+/* log_cursor pos once the page being filled was visited */
+#define LOG_CURSOR_END          (uint16_t)0xFFFF
+
+/* Descriptor of the records saved by log_flush(), in the RTC RAM */
+struct log_save {
+        uint8_t magic;
+        uint8_t count;
+        uint16_t page;          /* log_cur when saved */
+        uint16_t crc;           /* Of the flush page */
+};
+
+static struct log_idx log_idx[LOG_MAX_PAGES];
+static uint16_t log_pages;      /* Data pages in use */
+static uint16_t log_sealed;     /* Pages with an index entry */
+static uint8_t log_loaded;      /* log_init() called */
+static uint16_t log_cur;        /* Page being filled */
+static uint8_t log_fill;        /* Records in log_cur */
+static uint16_t log_seals;      /* Pages sealed, wraps */
+static struct log_rec log_buf[LOG_PAGE_RECS];   /* RAM copy of log_cur */
+#ifdef LOG_COMPRESS
+static uint8_t log_counts[LOG_MAX_PAGES];       /* Records per sealed page */
+static uint16_t log_recs;       /* Records in sealed pages */
+static uint8_t log_saved;       /* Records in the flush page, if valid */
+#endif
+
+static int log_set_idx(uint16_t page, struct log_idx *idx)
+{
+        if (log_idx[page].first != LOG_NONE)
+                log_sealed--;
+        if (idx->first != LOG_NONE)
+                log_sealed++;
+        log_idx[page] = *idx;
+        return eeprom_set_data_async(LOG_IDX_ADDR(page), (uint8_t *)idx,
+                                                        LOG_IDX_SIZE);
+}
+
+static int log_drop(uint16_t page)
+{
+        struct log_idx none;
+
+        if (log_idx[page].first == LOG_NONE)
+                return 0;
+#ifdef LOG_COMPRESS
+        log_recs -= log_counts[page];
+        log_counts[page] = 0;
+#endif
+        memset(&none, 0xFF, sizeof(none));
+        return log_set_idx(page, &none);
+}
+
+#ifdef LOG_COMPRESS
+/* Writes the buffered records packed, the index entry of the page is
+ * dropped first so a reset in between leaves no stale entry. The CRC of
+ * the written page goes to crc.
+ */
+static int log_write_packed(uint16_t page, uint16_t *crc)
+{
+        uint8_t buf[EEPROM_PAGE_SIZE];
+
+        if (log_drop(page) || log_pack(log_buf, log_fill, buf) < 0 ||
+            eeprom_set_data_async(LOG_PAGE_ADDR(page), buf,
+                                                        EEPROM_PAGE_SIZE))
+                return -1;
+        *crc = crc16_update(CRC16_INIT, buf, EEPROM_PAGE_SIZE);
+        log_counts[page] = log_fill;
+        log_recs += log_fill;
+        return 0;
+}
+#endif
+
+static int log_seal(void)
+{
+        struct log_idx idx;
+        uint32_t span;
+        uint16_t min = 0xFFFF, max = 0;
+        uint16_t page;
+        uint8_t i;
+
+        for (i = 0; i < log_fill; i++) {
+                if (log_buf[i].val < min)
+                        min = log_buf[i].val;
+                if (log_buf[i].val > max)
+                        max = log_buf[i].val;
+        }
+        span = log_buf[log_fill - 1].sec - log_buf[0].sec;
+        idx.first = log_buf[0].sec;
+        idx.span = span > 0xFFFF ? 0xFFFF : span;
+        idx.min = min >> 2;
+        idx.max = max >> 2 > 0xFF ? 0xFF : max >> 2;
+
+        page = log_cur;
+#ifdef LOG_COMPRESS
+        if (log_write_packed(page, &idx.crc))
+                return -1;
+#else
+        /* The RAM copy holds the whole page */
+        idx.crc = crc16_update(CRC16_INIT, (uint8_t *)log_buf,
+                                                        EEPROM_PAGE_SIZE);
+#endif
+        log_cur = (log_cur + 1) % log_pages;
+        log_seals++;
+        log_fill = 0;
+        return log_set_idx(page, &idx);
+}
+
+#ifdef LOG_COMPRESS
+/* Restores the records saved by log_flush() before a power failure. The
+ * descriptor stays valid until they are sealed, in case of another reset.
+ * Nothing is restored if the flush page was not completely written.
+ */
+static void log_restore(void)
+{
+        uint8_t buf[EEPROM_PAGE_SIZE];
+        struct log_save save;
+
+        log_saved = 0;
+        if (rtc_get_ram(RTC_RAM_LOG, (uint8_t *)&save, sizeof(save)) ||
+            save.magic != LOG_SAVE_MAGIC || save.page != log_cur)
+                return;
+        if (eeprom_get_data(LOG_FLUSH_ADDR, buf, EEPROM_PAGE_SIZE) ||
+            crc16_update(CRC16_INIT, buf, EEPROM_PAGE_SIZE) != save.crc)
+                return;
+        if (log_unpack(buf, log_buf, LOG_PAGE_RECS) != save.count) {
+                memset(log_buf, 0xFF, sizeof(log_buf));
+                return;
+        }
+        log_fill = save.count;
+        log_saved = save.count;
+}
+#endif
+
+/* Loads the index and finds the page to continue with, the one after the
+ * newest sealed page. Called on the first append or query otherwise, so
+ * the boot does not wait for the index reads.
+ */
+int log_init(void)
+{
+        uint32_t newest = 0;
+        uint16_t page;
+        uint8_t i;
+
+        log_loaded = 1;
+        log_pages = 0;
+        if (EEPROM_NBR_PAGES <= LOG_BASE_PAGE + LOG_IDX_PAGES)
+                return -1;
+        log_pages = EEPROM_NBR_PAGES - LOG_BASE_PAGE - LOG_IDX_PAGES;
+#ifdef LOG_COMPRESS
+        /* The flush page */
+        if (log_pages < 2) {
+                log_pages = 0;
+                return -1;
+        }
+        log_pages--;
+#endif
+        if (log_pages > LOG_MAX_PAGES)
+                log_pages = LOG_MAX_PAGES;
+
+        if (eeprom_get_data(LOG_IDX_ADDR(0), (uint8_t *)log_idx,
+                                        log_pages * LOG_IDX_SIZE)) {
+                log_pages = 0;
+                return -1;
+        }
+
+        log_cur = 0;
+        log_sealed = 0;
+        for (page = 0; page < log_pages; page++) {
+                if (log_idx[page].first == LOG_NONE)
+                        continue;
+                log_sealed++;
+                if (log_idx[page].first >= newest) {
+                        newest = log_idx[page].first;
+                        log_cur = (page + 1) % log_pages;
+                }
+        }
+
+        /* A sealed page here is the oldest one, reused on the next append */
+        log_fill = 0;
+        memset(log_buf, 0xFF, sizeof(log_buf));
+#ifdef LOG_COMPRESS
+        log_recs = 0;
+        for (page = 0; page < log_pages; page++) {
+                log_counts[page] = 0;
+                if (log_idx[page].first == LOG_NONE)
+                        continue;
+                if (eeprom_get_data(LOG_PAGE_ADDR(page), &i, 1))
+                        return -1;
+                if ((i & LOG_PACK_FLAG) && i != 0xFF)
+                        log_counts[page] = i & ~LOG_PACK_FLAG;
+                log_recs += log_counts[page];
+        }
+        log_restore();
+        return 0;
+#endif
+        if (log_idx[log_cur].first != LOG_NONE)
+                return 0;
+        if (eeprom_get_data(LOG_PAGE_ADDR(log_cur), (uint8_t *)log_buf,
+                                                        EEPROM_PAGE_SIZE))
+                return -1;
+        for (i = 0; i < LOG_PAGE_RECS && log_buf[i].sec != LOG_NONE; i++)
+                log_fill++;
+        if (log_fill == LOG_PAGE_RECS)
+                return log_seal();
+        return 0;
+}
+
+#ifdef LOG_COMPRESS
+static int log_seal_buf(void)
+{
+        uint8_t none = 0;
+
+        if (log_seal())
+                return -1;
+        memset(log_buf, 0xFF, sizeof(log_buf));
+        /* The saved records are sealed now. A stale descriptor left by a
+         * bus error names a previous page and is ignored by log_restore().
+         */
+        if (log_saved) {
+                log_saved = 0;
+                rtc_set_ram(RTC_RAM_LOG, &none, 1);
+        }
+        return 0;
+}
+
+/* Buffers the record, the page is sealed when it is full or the record
+ * would not fit packed, then the record starts the next page. The page
+ * writes are queued, a failure among them is returned by the next append
+ * (or log_flush()).
+ */
+int log_append(uint32_t sec, uint16_t ms, uint16_t val)
+{
+        struct log_rec *rec;
+        int ret;
+
+        if (!log_loaded)
+                log_init();
+        if (!log_pages)
+                return -1;
+        /* The writes of the previous append are done by now */
+        ret = eeprom_flush();
+        /* Still full after a failed seal */
+        if (log_fill == LOG_PAGE_RECS && log_seal_buf())
+                return -1;
+
+        rec = &log_buf[log_fill];
+        rec->sec = sec;
+        rec->ms = ms;
+        rec->val = val;
+        if (log_pack_size(log_buf, log_fill + 1) > EEPROM_PAGE_SIZE) {
+                rec->sec = LOG_NONE;
+                if (log_seal_buf())
+                        return -1;
+                rec = &log_buf[0];
+                rec->sec = sec;
+                rec->ms = ms;
+                rec->val = val;
+        }
+
+        if (++log_fill == LOG_PAGE_RECS && log_seal_buf())
+                return -1;
+        return ret;
+}
+#else
+/* Writes the record, queued like the seals, see the LOG_COMPRESS version */
+int log_append(uint32_t sec, uint16_t ms, uint16_t val)
+{
+        struct log_rec *rec;
+        int ret;
+
+        if (!log_loaded)
+                log_init();
+        if (!log_pages)
+                return -1;
+        ret = eeprom_flush();
+        rec = &log_buf[log_fill];
+
+        if (log_fill == 0) {
+                /* Reusing the oldest page, drop its index entry first and
+                 * write the whole page so the old records are erased.
+                 */
+                if (log_drop(log_cur))
+                        return -1;
+                memset(log_buf, 0xFF, sizeof(log_buf));
+        }
+        rec->sec = sec;
+        rec->ms = ms;
+        rec->val = val;
+
+        if (log_fill == 0) {
+                if (eeprom_set_data_async(LOG_PAGE_ADDR(log_cur),
+                                (uint8_t *)log_buf, EEPROM_PAGE_SIZE))
+                        return -1;
+        } else {
+                if (eeprom_set_data_async(LOG_PAGE_ADDR(log_cur) +
+                                log_fill * LOG_REC_SIZE, (uint8_t *)rec,
+                                LOG_REC_SIZE))
+                        return -1;
+        }
+
+        if (++log_fill == LOG_PAGE_RECS && log_seal())
+                return -1;
+        return ret;
+}
+#endif
+
+/* Saves the records not yet sealed, for log_init() to restore them after a
+ * power failure: packed into the flush page, with a descriptor in the RTC
+ * RAM. The descriptor is written first, its CRC catches a flush page write
+ * cut short. Waits for the page writes queued by the appends as well, the
+ * only ones without LOG_COMPRESS.
+ */
+int log_flush(void)
+{
+#ifdef LOG_COMPRESS
+        uint8_t buf[EEPROM_PAGE_SIZE];
+        struct log_save save;
+
+        if (!log_pages || !log_fill || log_fill == log_saved)
+                return eeprom_flush();
+        if (log_pack(log_buf, log_fill, buf) < 0)
+                return -1;
+        save.magic = LOG_SAVE_MAGIC;
+        save.count = log_fill;
+        save.page = log_cur;
+        save.crc = crc16_update(CRC16_INIT, buf, EEPROM_PAGE_SIZE);
+        if (rtc_set_ram(RTC_RAM_LOG, (uint8_t *)&save, sizeof(save)) ||
+            eeprom_set_data(LOG_FLUSH_ADDR, buf, EEPROM_PAGE_SIZE))
+                return -1;
+        log_saved = log_fill;
+        return 0;
+#else
+        return eeprom_flush();
+#endif
+}
+
+static uint8_t log_idx_match(const struct log_idx *idx,
+                                        const struct log_query *query)
+{
+        return idx->first <= query->to &&
+                idx->first + idx->span >= query->from &&
+                (uint16_t)idx->min << 2 <= query->max &&
+                ((uint16_t)idx->max << 2) + 3 >= query->min;
+}
+
+void log_cursor_init(struct log_cursor *cursor,
+                                        const struct log_query *query)
+{
+        if (!log_loaded)
+                log_init();
+        cursor->query = *query;
+        cursor->query.matches = 0;
+        cursor->query.pages_read = 0;
+        cursor->query.pages_bad = 0;
+        cursor->start = log_cur;
+        cursor->seals = log_seals;
+        cursor->pos = 0;
+}
+
+/* Copies the matching records of the next page that can hold any into recs
+ * (LOG_PAGE_RECS entries), oldest page first. Sealed pages are only read if
+ * their index entry overlaps the query and yield no records if they fail
+ * the CRC of the entry, the page being filled is in RAM. Appending may go
+ * on between the calls, the pages sealed meanwhile are visited as well,
+ * up to a ring of them so that the cursor ends. Records of pages reused
+ * before they were visited are lost.
+ * Returns the number of records copied, possibly 0, or -1 at the end of
+ * the log or on a bus error.
+ */
+int log_cursor_next(struct log_cursor *cursor, struct log_rec *recs)
+{
+        struct log_query *query = &cursor->query;
+        const struct log_rec *page_recs;
+#ifdef LOG_COMPRESS
+        uint8_t buf[EEPROM_PAGE_SIZE];
+#endif
+        uint16_t page, seals, end;
+        uint8_t i, nrecs, n = 0;
+
+        while (1) {
+                if (!log_pages || cursor->pos == LOG_CURSOR_END)
+                        return -1;
+                /* Each seal since the start moved log_cur on by a page,
+                 * the pages in between not visited yet were reused and
+                 * are visited at the end, with the newest records.
+                 */
+                seals = log_seals - cursor->seals;
+                if (cursor->pos < seals)
+                        cursor->pos = seals;
+                end = (seals < log_pages ? seals : log_pages) + log_pages;
+                /* The RAM copy of log_cur last, log_cur itself first as
+                 * it holds the oldest page until that is reused.
+                 */
+                if (cursor->pos >= end) {
+                        cursor->pos = LOG_CURSOR_END;
+                        page_recs = log_buf;
+                        nrecs = log_fill;
+                        break;
+                }
+                page = (cursor->start + cursor->pos++) % log_pages;
+                if (log_idx[page].first == LOG_NONE ||
+                    !log_idx_match(&log_idx[page], query))
+                        continue;
+#ifdef LOG_COMPRESS
+                if (eeprom_get_data(LOG_PAGE_ADDR(page), buf,
+                                                        EEPROM_PAGE_SIZE))
+                        return -1;
+                if (crc16_update(CRC16_INIT, buf, EEPROM_PAGE_SIZE) !=
+                                                log_idx[page].crc ||
+                    log_unpack(buf, recs, LOG_PAGE_RECS) < 0) {
+                        query->pages_bad++;
+                        recs[0].sec = LOG_NONE;
+                }
+#else
+                if (eeprom_get_data(LOG_PAGE_ADDR(page), (uint8_t *)recs,
+                                                        EEPROM_PAGE_SIZE))
+                        return -1;
+                if (crc16_update(CRC16_INIT, (uint8_t *)recs,
+                                EEPROM_PAGE_SIZE) != log_idx[page].crc) {
+                        query->pages_bad++;
+                        recs[0].sec = LOG_NONE;
+                }
+#endif
+                query->pages_read++;
+                page_recs = recs;
+                nrecs = LOG_PAGE_RECS;
+                break;
+        }
+
+        for (i = 0; i < nrecs; i++) {
+                if (page_recs[i].sec == LOG_NONE)
+                        break;
+                if (page_recs[i].sec < query->from ||
+                    page_recs[i].sec > query->to ||
+                    page_recs[i].val < query->min ||
+                    page_recs[i].val > query->max)
+                        continue;
+                recs[n++] = page_recs[i];
+        }
+        query->matches += n;
+        return n;
+}
+
+/* Visits the matching records, oldest first */
+int log_query(struct log_query *query, log_visit_t visit)
+{
+        struct log_cursor cursor;
+        struct log_rec recs[LOG_PAGE_RECS];
+        int n, i;
+
+        log_cursor_init(&cursor, query);
+        while ((n = log_cursor_next(&cursor, recs)) >= 0) {
+                for (i = 0; visit && i < n; i++)
+                        visit(&recs[i]);
+        }
+        query->matches = cursor.query.matches;
+        query->pages_read = cursor.query.pages_read;
+        query->pages_bad = cursor.query.pages_bad;
+        return log_pages ? 0 : -1;
+}
+
+/* Records stored, 0 until the log is loaded */
+uint16_t log_get_count(void)
+{
+#ifdef LOG_COMPRESS
+        return log_recs + log_fill;
+#else
+        return log_sealed * LOG_PAGE_RECS + log_fill;
+#endif
+}
+
+/* Records stored when full, an upper bound with LOG_COMPRESS where the
+ * page being filled is in RAM.
+ */
+uint16_t log_get_capacity(void)
+{
+#ifdef LOG_COMPRESS
+        return (log_pages + 1) * LOG_PAGE_RECS;
+#else
+        return log_pages * LOG_PAGE_RECS;
+#endif
+}
@@ -0,0 +1,103 @@
+/*
+ * log.h
+ *
+ * Description: Sample log in the EEPROM with a per-page summary index.
+ *
+ * Records are fixed size and never cross a page, erased bytes (0xFF) mark
+ * the unused part of the page being filled. When a page is full it is
+ * sealed: its first time, time span, value range and the CRC-16 of the
+ * page go into the index, which is kept in a reserved EEPROM region and
+ * cached in RAM. Queries check the cached index and read only the pages
+ * that can match, a page that fails its CRC is skipped. The data
+ * pages are used as a ring, the oldest page is reused when the log is full.
+ *
+ * EEPROM layout, in pages: 0 demo data (main.c), LOG_IDX_PAGES index,
+ * then up to LOG_MAX_PAGES data pages.
+ *
+ * With LOG_COMPRESS (common.h) the page being filled is kept in RAM only
+ * and written packed when sealed (log/log_pack.h), as many records as fit
+ * into a page. Records not yet sealed are lost on reset unless saved with
+ * log_flush(), e.g. on a power failure, into the page after the data
+ * pages. The index is the same, but the two formats are not compatible,
+ * erase the log when switching.
+ *
+ * Created: 2016-05-30
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+#include "../common.h"
+#include "../eeprom/eeprom.h"
+
+/* Data pages indexed, costs LOG_IDX_SIZE bytes of RAM each */
+#ifndef LOG_MAX_PAGES
+#define LOG_MAX_PAGES           (uint16_t)96
+#endif
+
+#define LOG_BASE_PAGE           (uint16_t)1
+#define LOG_REC_SIZE            (uint8_t)8
+#ifdef LOG_COMPRESS
+/* Records per packed page at most, costs LOG_REC_SIZE bytes of RAM each */
+#define LOG_PAGE_RECS           (uint8_t)24
+#else
+#define LOG_PAGE_RECS           (EEPROM_PAGE_SIZE / LOG_REC_SIZE)
+#endif
+#define LOG_IDX_SIZE            (uint8_t)10
+#define LOG_IDX_PAGES           ((LOG_MAX_PAGES * LOG_IDX_SIZE + \
+                                EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE)
+
+/* Unused record or index entry (erased EEPROM) */
+#define LOG_NONE                (uint32_t)0xFFFFFFFF
+
+/* Log record, stored as is (little endian) */
+struct log_rec {
+        uint32_t sec;           /* RTC seconds, see rtc_mktime() */
+        uint16_t ms;
+        uint16_t val;           /* 10-bit ADC value */
+};
+
+/* Index entry of a sealed page */
+struct log_idx {
+        uint32_t first;         /* Time of the first record, or LOG_NONE */
+        uint16_t span;          /* Seconds to the last record, saturated */
+        uint8_t min;            /* Value range / 4, rounded down */
+        uint8_t max;
+        uint16_t crc;           /* Of the page as written, crc/crc16.h */
+};
+
+/* Query, records with from <= sec <= to and min <= val <= max */
+struct log_query {
+        uint32_t from;
+        uint32_t to;
+        uint16_t min;
+        uint16_t max;
+        uint16_t matches;       /* Set by log_query() */
+        uint16_t pages_read;    /* Set by log_query() */
+        uint16_t pages_bad;     /* Read but failed the CRC, ditto */
+};
+
+/* Incremental query, see log_cursor_next() */
+struct log_cursor {
+        struct log_query query;
+        uint16_t start;         /* Oldest page when started */
+        uint16_t seals;         /* Pages sealed before the start */
+        uint16_t pos;           /* Pages visited from start */
+};
+
+typedef void (*log_visit_t)(const struct log_rec *rec);
+
+int log_init(void);
+int log_append(uint32_t sec, uint16_t ms, uint16_t val);
+int log_flush(void);
+int log_query(struct log_query *query, log_visit_t visit);
+void log_cursor_init(struct log_cursor *cursor,
+                                        const struct log_query *query);
+int log_cursor_next(struct log_cursor *cursor, struct log_rec *recs);
+uint16_t log_get_count(void);
+uint16_t log_get_capacity(void);
+
+#endif /* LOG_H_ */
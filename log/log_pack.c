@@ -0,0 +1,229 @@
+/*
+ * log_pack.c
+ *
+ * Created: 2016-06-08
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <string.h>
+#include "../common.h"
+#include "../eeprom/eeprom.h"
+#include "log.h"
+#include "log_pack.h"
+
+#define LOG_PACK_FIELDS         3
+#define LOG_PACK_KMAX           12
+/* Bits for the bit stream */
+#define LOG_PACK_BITS           ((EEPROM_PAGE_SIZE - LOG_PACK_HDR_SIZE) * 8)
+
+static uint32_t log_pack_zigzag(int32_t v)
+{
+        return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t log_pack_unzigzag(uint32_t v)
+{
+        return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/* Deltas of record i to record i - 1, zigzag coded */
+static uint32_t log_pack_delta(const struct log_rec *recs, uint8_t i,
+                                                        uint8_t field)
+{
+        switch (field) {
+        case 0:
+                return log_pack_zigzag((int32_t)(recs[i].sec -
+                                                recs[i - 1].sec - 1));
+        case 1:
+                return log_pack_zigzag((int16_t)(recs[i].ms -
+                                                recs[i - 1].ms));
+        default:
+                return log_pack_zigzag((int16_t)(recs[i].val -
+                                                recs[i - 1].val));
+        }
+}
+
+static uint8_t log_pack_rice_len(uint32_t v, uint8_t k)
+{
+        uint32_t q = v >> k;
+
+        return q < LOG_PACK_ESC ? q + 1 + k : LOG_PACK_ESC + 32;
+}
+
+/* Picks the Rice parameter with the fewest bits for a field, returns the
+ * bits (saturated) and the parameter in k.
+ */
+static uint16_t log_pack_best(const struct log_rec *recs, uint8_t n,
+                                                uint8_t field, uint8_t *k)
+{
+        uint16_t bits, best = 0xFFFF;
+        uint8_t i, j;
+
+        for (j = 0; j <= LOG_PACK_KMAX; j++) {
+                bits = 0;
+                for (i = 1; i < n && bits < best; i++)
+                        bits += log_pack_rice_len(log_pack_delta(recs, i,
+                                                        field), j);
+                if (bits < best) {
+                        best = bits;
+                        *k = j;
+                }
+        }
+        return best;
+}
+
+static uint16_t log_pack_params(const struct log_rec *recs, uint8_t n,
+                                        uint8_t k[LOG_PACK_FIELDS])
+{
+        uint16_t bits = 0;
+        uint8_t field;
+
+        for (field = 0; field < LOG_PACK_FIELDS; field++) {
+                bits += log_pack_best(recs, n, field, &k[field]);
+                if (bits > LOG_PACK_BITS)
+                        return 0xFFFF;
+        }
+        return bits;
+}
+
+static void log_bits_put(struct log_bits *b, uint32_t v, uint8_t len)
+{
+        while (len--) {
+                if (v & ((uint32_t)1 << len))
+                        b->buf[b->pos >> 3] |= 0x80 >> (b->pos & 7);
+                b->pos++;
+        }
+}
+
+/* Reading past the bit stream moves pos beyond LOG_PACK_BITS, reads zeros */
+static uint32_t log_bits_get(struct log_bits *b, uint8_t len)
+{
+        uint32_t v = 0;
+
+        while (len--) {
+                v <<= 1;
+                if (b->pos >= LOG_PACK_BITS) {
+                        b->pos = LOG_PACK_BITS + 1;
+                        continue;
+                }
+                if (b->buf[b->pos >> 3] & (0x80 >> (b->pos & 7)))
+                        v |= 1;
+                b->pos++;
+        }
+        return v;
+}
+
+static void log_bits_put_rice(struct log_bits *b, uint32_t v, uint8_t k)
+{
+        uint32_t q = v >> k;
+
+        if (q >= LOG_PACK_ESC) {
+                log_bits_put(b, 0xFFFF, LOG_PACK_ESC);
+                log_bits_put(b, v, 32);
+                return;
+        }
+        log_bits_put(b, 0xFFFF, q);
+        log_bits_put(b, 0, 1);
+        log_bits_put(b, v, k);
+}
+
+static uint32_t log_bits_get_rice(struct log_bits *b, uint8_t k)
+{
+        uint32_t q = 0;
+
+        while (q < LOG_PACK_ESC && log_bits_get(b, 1))
+                q++;
+        if (q == LOG_PACK_ESC)
+                return log_bits_get(b, 32);
+        return (q << k) | log_bits_get(b, k);
+}
+
+/* Packed size of n records in bytes, LOG_PACK_TOO_BIG if they do not fit
+ * into a page.
+ */
+uint8_t log_pack_size(const struct log_rec *recs, uint8_t n)
+{
+        uint8_t k[LOG_PACK_FIELDS];
+        uint16_t bits;
+
+        if (!n || n > LOG_PACK_MAX_RECS)
+                return LOG_PACK_TOO_BIG;
+        bits = log_pack_params(recs, n, k);
+        if (bits > LOG_PACK_BITS)
+                return LOG_PACK_TOO_BIG;
+        return LOG_PACK_HDR_SIZE + (bits + 7) / 8;
+}
+
+/* Packs n records into a page (EEPROM_PAGE_SIZE bytes, the unused part is
+ * left erased). Returns the packed size, or -1 if they do not fit.
+ */
+int log_pack(const struct log_rec *recs, uint8_t n, uint8_t *page)
+{
+        uint8_t k[LOG_PACK_FIELDS];
+        struct log_bits b;
+        uint8_t i, field;
+        uint16_t bits;
+
+        if (!n || n > LOG_PACK_MAX_RECS)
+                return -1;
+        bits = log_pack_params(recs, n, k);
+        if (bits > LOG_PACK_BITS)
+                return -1;
+
+        page[0] = LOG_PACK_FLAG | n;
+        memcpy(&page[1], &recs[0], LOG_REC_SIZE);
+        page[1 + LOG_REC_SIZE] = (k[0] << 4) | k[1];
+        page[2 + LOG_REC_SIZE] = k[2];
+        memset(&page[LOG_PACK_HDR_SIZE], 0,
+                                EEPROM_PAGE_SIZE - LOG_PACK_HDR_SIZE);
+
+        b.buf = &page[LOG_PACK_HDR_SIZE];
+        b.pos = 0;
+        for (i = 1; i < n; i++) {
+                for (field = 0; field < LOG_PACK_FIELDS; field++)
+                        log_bits_put_rice(&b, log_pack_delta(recs, i, field),
+                                                                k[field]);
+        }
+        /* Erased tail, saves programming the unused bytes to zero */
+        i = LOG_PACK_HDR_SIZE + (bits + 7) / 8;
+        memset(&page[i], 0xFF, EEPROM_PAGE_SIZE - i);
+        return i;
+}
+
+/* Unpacks a page into recs (size entries), the entries after the records
+ * are marked unused. Returns the number of records, or -1 if the page is
+ * not a packed page or is corrupt, e.g. half-written.
+ */
+int log_unpack(uint8_t *page, struct log_rec *recs, uint8_t size)
+{
+        uint8_t k[LOG_PACK_FIELDS];
+        struct log_bits b;
+        uint8_t i, n;
+
+        n = page[0] & ~LOG_PACK_FLAG;
+        if (!(page[0] & LOG_PACK_FLAG) || !n || n > LOG_PACK_MAX_RECS ||
+            n > size)
+                return -1;
+        k[0] = page[1 + LOG_REC_SIZE] >> 4;
+        k[1] = page[1 + LOG_REC_SIZE] & 0x0F;
+        k[2] = page[2 + LOG_REC_SIZE];
+        if (k[0] > LOG_PACK_KMAX || k[1] > LOG_PACK_KMAX ||
+            k[2] > LOG_PACK_KMAX)
+                return -1;
+
+        memcpy(&recs[0], &page[1], LOG_REC_SIZE);
+        b.buf = &page[LOG_PACK_HDR_SIZE];
+        b.pos = 0;
+        for (i = 1; i < n; i++) {
+                recs[i].sec = recs[i - 1].sec + 1 +
+                        log_pack_unzigzag(log_bits_get_rice(&b, k[0]));
+                recs[i].ms = recs[i - 1].ms +
+                        log_pack_unzigzag(log_bits_get_rice(&b, k[1]));
+                recs[i].val = recs[i - 1].val +
+                        log_pack_unzigzag(log_bits_get_rice(&b, k[2]));
+                if (b.pos > LOG_PACK_BITS)
+                        return -1;
+        }
+        memset(&recs[n], 0xFF, (size - n) * sizeof(*recs));
+        return n;
+}
@@ -0,0 +1,46 @@
+/*
+ * log_pack.h
+ *
+ * Description: Delta + Rice coding of a page of log records, used by the
+ * log with LOG_COMPRESS (common.h).
+ *
+ * Page layout: a header byte LOG_PACK_FLAG | number of records (an erased
+ * page reads 0xFF, i.e. no valid count), the first record as is, a byte of
+ * Rice parameters for the second and the time deltas and one for the value
+ * deltas, then a bit stream (MSB first) with the deltas of each following
+ * record to the previous one: seconds - 1, milliseconds and value, all
+ * zigzag coded. A Rice code is the quotient in unary (ones ended by a zero)
+ * and k remainder bits. Quotients from LOG_PACK_ESC on are sent as
+ * LOG_PACK_ESC ones followed by the 32-bit value, e.g. for a time gap.
+ *
+ * Decoding needs the page and a struct log_bits only.
+ *
+ * Created: 2016-06-08
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef LOG_PACK_H_
+#define LOG_PACK_H_
+
+#include <stdint.h>
+#include "log.h"
+
+#define LOG_PACK_FLAG           (uint8_t)0x80
+#define LOG_PACK_HDR_SIZE       (1 + LOG_REC_SIZE + 2)
+#define LOG_PACK_ESC            12
+#define LOG_PACK_MAX_RECS       (uint8_t)0x7E
+/* Returned by log_pack_size() if the records do not fit into a page */
+#define LOG_PACK_TOO_BIG        (uint8_t)0xFF
+
+/* Bit position in a packed page */
+struct log_bits {
+        uint8_t *buf;
+        uint16_t pos;
+};
+
+uint8_t log_pack_size(const struct log_rec *recs, uint8_t n);
+int log_pack(const struct log_rec *recs, uint8_t n, uint8_t *page);
+int log_unpack(uint8_t *page, struct log_rec *recs, uint8_t size);
+
+#endif /* LOG_PACK_H_ */
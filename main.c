@@ -20,20 +20,69 @@
 #include "common.h"
 #include "uart/uart.h"
 #include "i2c/i2c.h"
+#include "i2c/twi/twi_trace.h"
 #include "rtc/rtc.h"
 #include "eeprom/eeprom.h"
+#include "log/log.h"
 #include "adc/adc.h"
+#include "slave/slave.h"
+#include "clock/clock.h"
+#include "clock/timebase.h"
+#include "sched/sched.h"
+#include "alarm/alarm.h"
+#include "i2c/i2c_regs.h"
+#include "bench/bench.h"
+#include "profile/profile.h"
+#include "mem/mem.h"
+#include "dlog/dlog.h"
+#include "sync/sync.h"
+
+#ifndef FAST_BOOT
+/* Dummy debug strings, in flash */
+static const char Dummy_EEPROM[] PROGMEM = "EEPROM_Dummy_data";
+static const char Dummy_RTC_RAM[] PROGMEM = "RTC_RAM_Dummy_data";
+#endif
+
+/* Scheduler events */
+#define EV_BUTTON               (uint8_t)0x00
+#define EV_DUMP                 (uint8_t)0x01
+#define EV_POWER                (uint8_t)0x02
+#define EV_SYNC                 (uint8_t)0x03
+#define EV_TIMEBASE             (uint8_t)0x04
+
+/* TX ring room left for other output by the sync task */
+#define SYNC_HEADROOM           32
+
+/* Alarm ids */
+#define ALARM_QUARTER           (uint8_t)0
 
-/* Dummy debug strings */
-static const char Dummy_EEPROM[] = "EEPROM_Dummy_data";
-static const char Dummy_RTC_RAM[] = "RTC_RAM_Dummy_data";
+/* Timer0 overflows per second */
+#define TMR0_TICKS_PER_SEC      70
+
+/* Clock ticks from reset to the first sample, 0 until then */
+static uint32_t g_boot_ticks = 0;
 
-/* Timer0 ISR g_tmr0_sec ticker  */
-static volatile uint8_t g_tmr0_sec = 0;
 /* Timer0 ISR g_tmr0_ticker, overflow ticker */
 static volatile uint32_t g_tmr0_ticker = 0;
-/* Print flag, g_print, set in INT4 ISR to signal button pressed */
-static volatile uint8_t g_print = 0x00;
+
+#ifndef FAST_BOOT
+/* Dummy data buffer, sized for the RTC RAM user area */
+static char g_buf[RTC_RAM_USER_SIZE + 1];
+#endif
+
+#ifdef APP_ADC_EEPROM
+static uint8_t g_adc_prev = 0;
+
+/* Log dump in progress, up to DUMP_CHUNK_RECS records per dump_task() run */
+static struct log_cursor g_dump;
+static struct log_rec g_dump_recs[LOG_PAGE_RECS];
+static uint8_t g_dump_n, g_dump_pos;
+static uint8_t g_dump_active = 0;
+/* UART output of a chunk, and TX ring room left for other output */
+#define DUMP_CHUNK_RECS         4
+#define DUMP_CHUNK_CHARS        (DUMP_CHUNK_RECS * 20)
+#define DUMP_HEADROOM           32
+#endif
 
 void led_init(void)
 {
@@ -54,7 +103,6 @@ void led_toggle(void)
 
 void timer0_init(void)
 {
-        g_tmr0_sec = 0;
         TCCR0A = 0x00;          /* Normal mode */
         TCCR0B = 0x05;          /* F_CPU/1024 pre-scaling */
         TCNT0 = 0x00;           /* Clear counter 0 */
@@ -72,133 +120,403 @@ void button_init(void)
         EIMSK |= (1 << INT4);                   /* Activate INT4 IRQ */
 }
 
-int main(void)
+#ifdef POWER_FAIL
+void power_fail_init(void)
+{
+        /* Bandgap on the positive input, AIN1 on the negative one. The
+         * output rises when AIN1 falls below 1.1 V.
+         */
+        DIDR1 |= (1 << AIN1D);                  /* AIN1 digital input off */
+        ACSR = (1 << ACBG) | (1 << ACIS1) | (1 << ACIS0);
+        ACSR |= (1 << ACI);                     /* Clear a stale flag */
+        ACSR |= (1 << ACIE);
+}
+
+/* Power-fail task, urgent event (EV_POWER) posted by the comparator ISR.
+ * Saves the buffered log records while the supply holds, then re-arms the
+ * comparator in case the supply recovers.
+ */
+void power_task(uint8_t arg)
+{
+#ifdef APP_ADC_EEPROM
+        log_flush();
+#endif
+        ACSR |= (1 << ACI) | (1 << ACIE);
+}
+#endif
+
+#if defined(APP_ADC_EEPROM) || defined(EEPROM_SYNC)
+/* UART TX callback (interrupt context), resumes the tasks waiting for room
+ * in the TX ring. There is one callback for both, each task waits again if
+ * the room is still short for it.
+ */
+void tx_resume(void)
+{
+#ifdef APP_ADC_EEPROM
+        if (g_dump_active)
+                sched_post_isr(EV_DUMP, 0);
+#endif
+#ifdef EEPROM_SYNC
+        if (sync_pending())
+                sched_post_isr(EV_SYNC, 0);
+#endif
+}
+#endif
+
+#ifdef EEPROM_SYNC
+/* UART RX callback (interrupt context), runs the sync task */
+void sync_rx_ready(void)
+{
+        sched_post_isr(EV_SYNC, 0);
+}
+
+/* EEPROM mirror task (EV_SYNC), parses the received requests and serves
+ * one EEPROM page per run, yielding while the UART TX ring is short of a
+ * frame.
+ */
+void sync_task(uint8_t arg)
+{
+        uint8_t c;
+
+        while (uart0_rx_get(&c) == 0)
+                sync_rx(c);
+        if (!sync_pending())
+                return;
+        if (uart0_tx_free() < SYNC_FRAME_MAX + SYNC_HEADROOM) {
+                uart0_tx_wait(SYNC_FRAME_MAX + SYNC_HEADROOM, tx_resume);
+                return;
+        }
+        sync_step();
+        sched_post(EV_SYNC, 0);
+}
+#endif
+
+#ifdef APP_ADC_EEPROM
+/* Prints one log sample */
+void log_print_rec(const struct log_rec *rec)
+{
+        printf_P(PSTR("%02d:%02d:%02d.%03d %d\n"), (int)(rec->sec / 3600 % 24),
+                        (int)(rec->sec / 60 % 60), (int)(rec->sec % 60),
+                        rec->ms, rec->val);
+}
+
+/* Log dump task (EV_DUMP), formats a chunk of a log page per run and
+ * yields to the other tasks in between. Waits for the UART TX ring to drain
+ * rather than blocking in printf.
+ */
+void dump_task(uint8_t arg)
+{
+        int n;
+        uint8_t i;
+
+        if (uart0_tx_free() < DUMP_CHUNK_CHARS + DUMP_HEADROOM) {
+                uart0_tx_wait(DUMP_CHUNK_CHARS + DUMP_HEADROOM, tx_resume);
+                return;
+        }
+        if (g_dump_pos == g_dump_n) {
+                n = log_cursor_next(&g_dump, g_dump_recs);
+                if (n < 0) {
+                        printf_P(PSTR("%d of %d records, %d pages read, "
+                                        "%d bad\n"),
+                                        g_dump.query.matches, log_get_count(),
+                                        g_dump.query.pages_read,
+                                        g_dump.query.pages_bad);
+                        g_dump_active = 0;
+                        return;
+                }
+                g_dump_n = n;
+                g_dump_pos = 0;
+        }
+        for (i = 0; i < DUMP_CHUNK_RECS && g_dump_pos < g_dump_n; i++)
+                log_print_rec(&g_dump_recs[g_dump_pos++]);
+        sched_post(EV_DUMP, 0);
+}
+#endif
+
+/* Timer1 compare callback (interrupt context), a timebase window read */
+void timebase_wake(void)
 {
-        struct rtc_time_var rtc;
-        uint8_t timer0_prev_sec;
-        char buf[256];
+        sched_post_isr(EV_TIMEBASE, 0);
+}
+
+/* Button task, runs upon button-press (EV_BUTTON) */
+void button_task(uint8_t arg)
+{
+#ifdef APP_ADC_EEPROM
+        struct log_query query;
+
+        /* Start dumping the whole log upon button-press, the dump runs
+         * alongside the sampling (dump_task()).
+         */
+        if (!g_dump_active) {
+                query.from = 0;
+                query.to = LOG_NONE;
+                query.min = 0;
+                query.max = 0xFFFF;
+                log_cursor_init(&g_dump, &query);
+                g_dump_n = g_dump_pos = 0;
+                g_dump_active = 1;
+                printf_P(PSTR("Stored data:\n"));
+                sched_post(EV_DUMP, 0);
+        }
+#else
+        /* Dummy print upon button-press */
+        DLOG_PRINTF("Button pressed\n");
+#endif
+#ifdef TWI_TRACE
+        twi_trace_dump();
+#endif
+        sched_print_stats();
+#ifdef PROFILE
+        profile_print();
+#endif
+        mem_print();
+        DLOG_PRINTF("Timebase: %lu ticks/s %ld ppm\n",
+                        (unsigned long)timebase_get_rate(),
+                        (long)timebase_get_ppm());
+}
 
+/* Alarm handler, every 15 minutes at :00, :15, :30 and :45 */
+void quarter_alarm(uint8_t id)
+{
+        DLOG_PRINTF("Alarm %d: quarter hour\n", id);
+}
+
+/* Main task, runs every second */
+void second_task(uint8_t arg)
+{
+        struct rtc_time rtc;
+#ifdef APP_I2C_SLAVE
+        struct slave_regs *regs;
+#endif
 #ifdef APP_ADC_EEPROM
-        uint8_t adc_curr = 0;
-        uint8_t adc_prev = 0;
+        struct timebase_stamp stamp;
+        uint8_t adc_curr;
         int adc_diff;
+#endif
+
+        led_toggle();
+        if (rtc_get_time(&rtc))
+                return;
+        if (!g_boot_ticks) {
+                /* Timer1 starts right after reset, see main() */
+                g_boot_ticks = clock_now32();
+                DLOG_PRINTF("Boot to first sample: %lu us\n",
+                                (unsigned long)(g_boot_ticks /
+                                                (CLOCK_HZ / 1000000UL)));
+        }
+        alarm_tick(rtc_mktime(&rtc));
+
+#ifdef APP_I2C_SLAVE
+        /* Refresh the register map served to the host */
+        regs = slave_regs_begin();
+        regs->sec = bin2bcd(rtc.sec);
+        regs->min = bin2bcd(rtc.min);
+        regs->adc_val = adc0_get_val();
+        regs->adc_pct = adc0_get_val_percentage();
+#ifdef APP_ADC_EEPROM
+        regs->log_len = log_get_count() * LOG_REC_SIZE;
+        regs->log_size = log_get_capacity() * LOG_REC_SIZE;
+#endif
+        slave_regs_commit();
+#endif
+
+#ifdef APP_ADC_EEPROM
+        /* Poll the current ADC value to see if there is a +/-10%
+         * deviation since the last sample.
+         */
+        adc_curr = adc0_get_val_percentage();
+        adc_diff = adc_curr - g_adc_prev;
+        g_adc_prev = adc_curr;
+        if (adc_diff > -10 && adc_diff < 10)
+                return;
+
+        /* Log the ADC value with the RTC time, with milliseconds once the
+         * timebase is calibrated.
+         */
+        if (timebase_now(&stamp)) {
+                stamp.sec = rtc_mktime(&rtc);
+                stamp.ms = 0;
+        }
+        DLOG_PRINTF("Logged %02d:%02d.%03d - %d%%\n",
+                        (int)(stamp.sec / 60 % 60), (int)(stamp.sec % 60),
+                        stamp.ms, adc_curr);
+        log_append(stamp.sec, stamp.ms, adc0_get_val());
+#else
+        /* Print out the ADC value and the RTC time every second */
+        DLOG_PRINTF("RTC time - %02d:%02d:%02d\n",
+                        rtc.hour, rtc.min, rtc.sec);
+        DLOG_PRINTF("Current adc_val:%d %d%%\n\n",
+                        adc0_get_val(), adc0_get_val_percentage());
+#endif
+}
+
+#ifndef FAST_BOOT
+/* Writes dummy data to the RTC RAM and the EEPROM and reads it back */
+void demo_run(void)
+{
+        /* Write dummy data to the RTC RAM */
+        strcpy_P(g_buf, Dummy_RTC_RAM);
+        rtc_set_ram_buf((uint8_t *)g_buf, strlen(g_buf));
+
+        /* Write dummy data to the EEPROM */
+        strcpy_P(g_buf, Dummy_EEPROM);
+        eeprom_set_data(0, (uint8_t *)g_buf, strlen(g_buf));
+
+        _delay_ms(1000);
+
+        /* Read and print dummy data from RTC RAM  */
+        memset(g_buf, 0, sizeof(g_buf));
+        rtc_get_ram_buf((uint8_t *)g_buf, strlen_P(Dummy_RTC_RAM));
+        DLOG_PRINTF("RTC RAM read result:%s\n", g_buf);
 
-        uint16_t eeprom_index = 0;
-        uint8_t eeprom_nbr_chars = 0;
+        /* Read and print dummy data from EEPROM  */
+        memset(g_buf, 0, sizeof(g_buf));
+        eeprom_get_data(0, (uint8_t *)g_buf, strlen_P(Dummy_EEPROM));
+        DLOG_PRINTF("EEPROM read result:%s\n\n", g_buf);
+}
 #endif
+
+int main(void)
+{
+        struct rtc_time rtc;
+
         /* Initialize UART0, serial printing over USB on Arduino Mega */
         uart0_init();
 
         /* Initialize blinking LED */
         led_init();
 
+        /* Initialize Timer1, free-running time base (also paces the
+         * bit-banged I2C bus)
+         */
+        clock_init();
+
         /* Initialize I2C */
         i2c_init();
+#ifdef APP_I2C_SLAVE
+        /* Answer host reads of the cached register map */
+        slave_init(SLAVE_I2C_ADDR);
+#endif
 
         /* Initialize Timer0 */
         timer0_init();
 
+        /* Initialize the scheduler and its tasks */
+        sched_init();
+        sched_add_event(EV_BUTTON, button_task);
+#ifdef APP_ADC_EEPROM
+        sched_add_event(EV_DUMP, dump_task);
+#endif
+#ifdef POWER_FAIL
+        sched_add_event(EV_POWER, power_task);
+#endif
+#ifdef EEPROM_SYNC
+        sched_add_event(EV_SYNC, sync_task);
+#endif
+        sched_add_periodic(TMR0_TICKS_PER_SEC, second_task);
+        sched_add_event(EV_TIMEBASE, timebase_task);
+        sched_add_periodic(1, timebase_task);
+
         /* Initialize INT4 button */
         button_init();
 
         /* Initialize ADC */
         adc0_init();
 
+#ifdef POWER_FAIL
+        /* Initialize the supply monitor */
+        power_fail_init();
+#endif
+
+#ifdef EEPROM_SYNC
+        /* Receive the EEPROM mirror requests */
+        uart0_rx_start(sync_rx_ready);
+#endif
+
         /* Enable global interrupts (used in I2C) */
         sei();
 
+#ifndef FAST_BOOT
         /* Added startup delay after IRQ-enable and followed by a boot print */
         _delay_ms(1000);
-        printf("\n\nTiny RTC firmware successfully started!\n\n");
-        printf("RTC DS1307 I2C-addr:0x%x\n", DS1307);
-        printf("EEPROM AT24C32 I2C-addr:0x%x\n\n", AT24C32);
+#endif
+        DLOG_PRINTF("\n\nTiny RTC firmware successfully started!\n\n");
+        DLOG_PRINTF("RTC DS1307 I2C-addr:0x%x\n", DS1307);
+        DLOG_PRINTF("EEPROM AT24C32 I2C-addr:0x%x\n\n", AT24C32);
 
+#ifndef FAST_BOOT
         rtc_init();
+        demo_run();
+#endif
 
-        /* Write dummy data to the RTC RAM */
-        rtc_set_ram_buf((uint8_t *)Dummy_RTC_RAM, strlen(Dummy_RTC_RAM));
+#ifdef APP_BENCHMARK
+        /* Time the bus and devices before any task runs */
+        bench_run();
+#endif
 
-        /* Write dummy data to the EEPROM */
-        eeprom_set_data(0, (uint8_t *)Dummy_EEPROM, strlen(Dummy_EEPROM));
+#if defined(APP_ADC_EEPROM) && !defined(FAST_BOOT)
+        /* Load the log index, appending continues after the newest page */
+        if (log_init())
+                DLOG_PRINTF("Log init failed\n");
+        else
+                DLOG_PRINTF("Log: %d of %d records\n\n", log_get_count(),
+                                                log_get_capacity());
+#endif
 
-        _delay_ms(1000);
+        /* Set up the alarms, any that came due during the reset fire on the
+         * first tick.
+         */
+        alarm_init(rtc_get_time(&rtc) ? 0 : rtc_mktime(&rtc));
+        alarm_set_every(ALARM_QUARTER, 15 * ALARM_MINUTE, 0, quarter_alarm);
 
-        /* Read and print dummy data from RTC RAM  */
-        memset(buf, 0, sizeof(buf));
-        rtc_get_ram_buf((uint8_t *)buf, strlen(Dummy_RTC_RAM));
-        printf("RTC RAM read result:%s\n", buf);
+        /* Calibrate Timer1 against the RTC seconds, runs on every tick */
+        timebase_init(timebase_wake);
 
-        /* Read and print dummy data from EEPROM  */
-        memset(buf, 0, sizeof(buf));
-        eeprom_get_data(0, (uint8_t *)buf, strlen(Dummy_EEPROM));
-        printf("EEPROM read result:%s\n\n", buf);
-
-        timer0_prev_sec = g_tmr0_sec;
-        /* Main loop */
-        while (1) {
-                if (g_print) {
-                        g_print = 0;
-#ifdef APP_ADC_EEPROM
-                        /* Read out stored EEPROM data upon button-press */
-                        eeprom_get_data(0, (uint8_t *)buf, eeprom_index);
-                        printf("Stored data[%d]:\n%s\n", eeprom_index, buf);
-#else
-                        /* Dummy print upon button-press */
-                        printf("Button pressed\n");
+#ifdef PROFILE
+        /* Profile from here on, the boot sequence is not representative */
+        profile_init();
 #endif
-                }
-
-                if (timer0_prev_sec == g_tmr0_sec)
-                        continue;
-                timer0_prev_sec = g_tmr0_sec;
-                led_toggle();
-                rtc_get_time_var(&rtc);
 
-#ifdef APP_ADC_EEPROM
-                /* Poll the current ADC value to see if there is a +/-10%
-                 * deviation since the last sample.
-                 */
-                adc_curr = adc0_get_val_percentage();
-                adc_diff = adc_curr - adc_prev;
-                adc_prev = adc_curr;
-                if (adc_diff > -10 && adc_diff < 10)
-                        continue;
-
-                /* Create a char-array containing the RTC-time and the ADC
-                 * percentage value and store it in the EEPROM.
-                 */
-                eeprom_nbr_chars = snprintf(buf, 16, "%d%d:%d%d - %d%%\n",
-                                rtc.min_10, rtc.min_1, rtc.sec_10, rtc.sec_1,
-                                adc0_get_val_percentage());
-                printf("eeprom_index:%d eeprom_nbr_chars:%d %s\n",
-                                eeprom_index, eeprom_nbr_chars, buf);
-                eeprom_set_data(eeprom_index, (uint8_t *)buf, eeprom_nbr_chars);
-                eeprom_index += eeprom_nbr_chars;
-#else
-                /* Print out the ADC value and the RTC time every second */
-                printf("Elapsed RTC time - min:%d%d sec:%d%d\n",
-                                rtc.min_10, rtc.min_1, rtc.sec_10, rtc.sec_1);
-                printf("Current adc_val:%d %d%%\n\n",
-                                adc0_get_val(), adc0_get_val_percentage());
+#ifdef FAST_BOOT
+        /* First sample now rather than one period after the start */
+        second_task(0);
 #endif
-        }
+
+        /* Run the tasks, sleeping while idle */
+        sched_run();
 }
 
 ISR(TIMER0_OVF_vect)
 {
+        PROFILE_ENTER();
         g_tmr0_ticker++;
-        if (g_tmr0_ticker % 70 == 0)
-                g_tmr0_sec++;
+        sched_tick_isr();
+        PROFILE_EXIT(PROFILE_TMR0);
 }
 
+#ifdef POWER_FAIL
+ISR(ANALOG_COMP_vect)
+{
+        PROFILE_ENTER();
+        /* Once per supply drop, power_task() re-arms */
+        ACSR &= ~(1 << ACIE);
+        sched_post_urgent_isr(EV_POWER, 0);
+        PROFILE_EXIT(PROFILE_POWER);
+}
+#endif
+
 ISR(INT4_vect)
 {
+        PROFILE_ENTER();
         static uint32_t tmr0_tck_track = 0;
 
         /* A simple de-bounce handler where all new IRQs shorter than
-         * ~300ms (20/70 * 1 sec) are discarded.
+         * ~300ms (20/70 * 1 sec) are discarded. The ticker is read as is,
+         * the Timer0 ISR cannot update it while this one runs.
          */
         if (tmr0_tck_track < g_tmr0_ticker)
-                g_print = 0x01;
+                sched_post_isr(EV_BUTTON, 0);
         tmr0_tck_track = g_tmr0_ticker + 20;
+        PROFILE_EXIT(PROFILE_INT4);
 }
\ No newline at end of file
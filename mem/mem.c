@@ -0,0 +1,54 @@
+/*
+ * mem.c
+ *
+ * Created: 2016-06-03
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <avr/io.h>
+#include "../common.h"
+#include "mem.h"
+
+/* Linker symbols, see the avr-libc memory sections */
+extern uint8_t __data_start, __data_end;
+extern uint8_t __bss_start, __bss_end;
+extern uint8_t __heap_start;
+
+void mem_paint(void) __attribute__((naked, used, section(".init3")));
+
+/* Runs from .init3, after the stack pointer is set up and before main(),
+ * nothing is on the stack yet.
+ */
+void mem_paint(void)
+{
+        uint8_t *p = &__heap_start;
+
+        while (p < (uint8_t *)SP)
+                *p++ = MEM_PAINT;
+}
+
+/* Bytes between the static data and the deepest stack use since reset */
+uint16_t mem_get_stack_unused(void)
+{
+        const uint8_t *p = &__heap_start;
+
+        while (p < (uint8_t *)SP && *p == MEM_PAINT)
+                p++;
+        return p - &__heap_start;
+}
+
+/* Stack high-water mark in bytes */
+uint16_t mem_get_stack_peak(void)
+{
+        return (RAMEND + 1 - (uint16_t)&__heap_start) - mem_get_stack_unused();
+}
+
+void mem_print(void)
+{
+        printf_P(PSTR("SRAM data:%u bss:%u stack peak:%u free:%u of %u\n"),
+                        (uint16_t)(&__data_end - &__data_start),
+                        (uint16_t)(&__bss_end - &__bss_start),
+                        mem_get_stack_peak(), mem_get_stack_unused(),
+                        RAMEND + 1 - (uint16_t)&__data_start);
+}
@@ -0,0 +1,28 @@
+/*
+ * mem.h
+ *
+ * Description: SRAM accounting. The free SRAM between the static data and
+ * the stack is painted at reset, before the static data is initialized,
+ * so the lowest unpainted byte is the stack high-water mark. The firmware
+ * uses no heap, i.e. everything above __heap_start belongs to the stack.
+ *
+ * The per-module static RAM is reported on the host from the object
+ * files, see tools/ram_report.c.
+ *
+ * Created: 2016-06-03
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef MEM_H_
+#define MEM_H_
+
+#include <stdint.h>
+
+#define MEM_PAINT               (uint8_t)0xC5
+
+uint16_t mem_get_stack_unused(void);
+uint16_t mem_get_stack_peak(void);
+void mem_print(void);
+
+#endif /* MEM_H_ */
@@ -0,0 +1,92 @@
+/*
+ * profile.c
+ *
+ * Created: 2016-06-02
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "../common.h"
+#include "../clock/clock.h"
+#include "profile.h"
+
+#ifdef PROFILE
+
+#define PROFILE_TICKS_US(t)     ((t) / (CLOCK_HZ / 1000000UL))
+
+static const char profile_names[PROFILE_SLOTS][7] PROGMEM = {
+        "adc", "twi", "tmr0", "tmr1", "int4", "uart", "power", "loop",
+        "jitter"
+};
+
+struct profile_slot profile_slots[PROFILE_SLOTS];
+static uint32_t profile_start;
+
+static void profile_clear(void)
+{
+        uint8_t i;
+
+        memset(profile_slots, 0, sizeof(profile_slots));
+        for (i = 0; i < PROFILE_SLOTS; i++)
+                profile_slots[i].min = 0xFFFF;
+        profile_start = clock_now32_isr();
+}
+
+void profile_init(void)
+{
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                profile_clear();
+        }
+}
+
+/* Adds a duration from the main loop, clamped to 16 bits */
+void profile_add(uint8_t slot, uint32_t ticks)
+{
+        if (ticks > 0xFFFF)
+                ticks = 0xFFFF;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                profile_add_isr(slot, ticks);
+        }
+}
+
+/* Prints the profile gathered since the previous call (or profile_init())
+ * and clears it. Times are in CPU cycles, the load in 1/1000 of the
+ * elapsed time.
+ */
+void profile_print(void)
+{
+        static struct profile_slot slots[PROFILE_SLOTS];
+        struct profile_slot *p;
+        uint32_t elapsed;
+        uint8_t i, j;
+
+        /* Snapshot, the ISRs keep counting while printing */
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                memcpy(slots, profile_slots, sizeof(slots));
+                elapsed = clock_now32_isr() - profile_start;
+                profile_clear();
+        }
+
+        printf_P(PSTR("profile %lu us, cycles min/avg/max, load 1/1000\n"),
+                                (unsigned long)PROFILE_TICKS_US(elapsed));
+        for (i = 0; i < PROFILE_SLOTS; i++) {
+                p = &slots[i];
+                if (!p->count)
+                        continue;
+                printf_P(PSTR("%-6S %7lu %6lu %6lu %6lu %4lu |"),
+                        profile_names[i],
+                        (unsigned long)p->count,
+                        (unsigned long)p->min * CLOCK_PRESCALE,
+                        (unsigned long)(p->total / p->count) * CLOCK_PRESCALE,
+                        (unsigned long)p->max * CLOCK_PRESCALE,
+                        (unsigned long)(elapsed && i != PROFILE_JITTER ?
+                                (uint64_t)p->total * 1000 / elapsed : 0));
+                for (j = 0; j < PROFILE_HIST_BINS; j++)
+                        printf_P(PSTR(" %u"), p->hist[j]);
+                printf_P(PSTR("\n"));
+        }
+}
+
+#endif /* PROFILE */
@@ -0,0 +1,88 @@
+/*
+ * profile.h
+ *
+ * Description: ISR and main-loop execution time profiler, enabled with
+ * PROFILE in common.h. PROFILE_ENTER()/PROFILE_EXIT() bracket an ISR body
+ * with Timer1 (clock/clock.h) reads, i.e. the time excludes the compiler
+ * generated register save and restore, roughly 20-60 cycles per ISR.
+ *
+ * Per slot the count, min/max/total and a histogram with power of two
+ * bins (bin n holds durations of 2^n to 2^(n+1)-1 ticks, the last one all
+ * longer durations) are accumulated,
+ * profile_print() reports and clears them. The main-loop slots hold the
+ * busy time of each scheduler iteration and the jitter of the periodic
+ * tasks, Timer0 tick to dispatch.
+ *
+ * Without PROFILE the macros expand to nothing.
+ *
+ * Created: 2016-06-02
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include "../common.h"
+
+#define PROFILE_ADC             0
+#define PROFILE_TWI             1
+#define PROFILE_TMR0            2
+#define PROFILE_TMR1            3
+#define PROFILE_INT4            4
+#define PROFILE_UART            5
+#define PROFILE_POWER           6
+#define PROFILE_LOOP            7
+#define PROFILE_JITTER          8
+#define PROFILE_SLOTS           9
+
+#define PROFILE_HIST_BINS       12
+
+struct profile_slot {
+        uint32_t count;
+        uint32_t total;
+        uint16_t min;
+        uint16_t max;
+        uint16_t hist[PROFILE_HIST_BINS];
+};
+
+#ifdef PROFILE
+
+#include <avr/io.h>
+
+extern struct profile_slot profile_slots[PROFILE_SLOTS];
+
+/* Adds a duration in ticks to a slot, with interrupts disabled */
+static inline void profile_add_isr(uint8_t slot, uint16_t ticks)
+{
+        struct profile_slot *p = &profile_slots[slot];
+        uint8_t bin = 0;
+
+        p->count++;
+        p->total += ticks;
+        if (ticks < p->min)
+                p->min = ticks;
+        if (ticks > p->max)
+                p->max = ticks;
+        while ((ticks >>= 1) && bin < PROFILE_HIST_BINS - 1)
+                bin++;
+        if (p->hist[bin] != 0xFFFF)
+                p->hist[bin]++;
+}
+
+#define PROFILE_ENTER()         uint16_t profile_t0 = TCNT1
+#define PROFILE_EXIT(slot)      profile_add_isr(slot, TCNT1 - profile_t0)
+
+void profile_init(void);
+void profile_add(uint8_t slot, uint32_t ticks);
+void profile_print(void);
+
+#else
+
+#define PROFILE_ENTER()
+#define PROFILE_EXIT(slot)
+
+#endif /* PROFILE */
+
+#endif /* PROFILE_H_ */
@@ -0,0 +1,48 @@
+/*
+ * ds1307.h
+ *
+ * Description: DS1307 register map, see i2c/i2c_regs.h for the field
+ * descriptor format. Time and date fields are BCD.
+ *
+ * Created: 2016-05-16
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef DS1307_H_
+#define DS1307_H_
+
+#include "../i2c/i2c_regs.h"
+
+/* Registers */
+#define DS1307_REG_SEC          (uint8_t)0x00
+#define DS1307_REG_MIN          (uint8_t)0x01
+#define DS1307_REG_HOUR         (uint8_t)0x02
+#define DS1307_REG_WDAY         (uint8_t)0x03
+#define DS1307_REG_MDAY         (uint8_t)0x04
+#define DS1307_REG_MON          (uint8_t)0x05
+#define DS1307_REG_YEAR         (uint8_t)0x06
+#define DS1307_REG_CTRL         (uint8_t)0x07
+#define DS1307_REG_RAM          (uint8_t)0x08   /* Battery-backed RAM */
+#define DS1307_NBR_REGS         (uint8_t)8      /* Clock + control */
+#define DS1307_RAM_SIZE         (uint8_t)56
+
+/* Fields: register, shift, width */
+#define DS1307_CH               DS1307_REG_SEC, 7, 1    /* Clock halt */
+#define DS1307_SEC              DS1307_REG_SEC, 0, 7
+#define DS1307_SEC_10           DS1307_REG_SEC, 4, 3
+#define DS1307_SEC_1            DS1307_REG_SEC, 0, 4
+#define DS1307_MIN              DS1307_REG_MIN, 0, 7
+#define DS1307_MIN_10           DS1307_REG_MIN, 4, 3
+#define DS1307_MIN_1            DS1307_REG_MIN, 0, 4
+#define DS1307_12H              DS1307_REG_HOUR, 6, 1   /* 12-hour mode */
+#define DS1307_HOUR             DS1307_REG_HOUR, 0, 6   /* 24-hour mode */
+#define DS1307_WDAY             DS1307_REG_WDAY, 0, 3
+#define DS1307_MDAY             DS1307_REG_MDAY, 0, 6
+#define DS1307_MON              DS1307_REG_MON, 0, 5
+#define DS1307_YEAR             DS1307_REG_YEAR, 0, 8
+#define DS1307_OUT              DS1307_REG_CTRL, 7, 1
+#define DS1307_SQWE             DS1307_REG_CTRL, 4, 1
+#define DS1307_RS               DS1307_REG_CTRL, 0, 2
+
+#endif /* DS1307_H_ */
@@ -7,67 +7,138 @@
 #include <stdio.h>
 #include <string.h>
 #include "rtc.h"
+#include "ds1307.h"
 #include "../i2c/i2c.h"
 #include "../common.h"
 
-/* DS1307 RTC register for start/stop time counter */
-#define RTC_REG_START_TIME      (uint8_t)0x00
+/* Memory block sizes, in bytes */
+#define RTC_RAM_SIZE            DS1307_RAM_SIZE
 
-/* DS1307 RTC register address pointing at the internal RAM-buffer */
-#define RTC_REG_RAM_BUF_START   (uint8_t)0x08
 
-/* Memory block sizes, in bytes */
-#define RTC_RAM_SIZE            (uint8_t)56
+/* Days before each month, non-leap year */
+static const uint16_t rtc_yday[12] = {
+        0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
 
+/* Starts the oscillator by clearing the CH bit of the seconds register sec,
+ * keeping the seconds. A DS1307 that lost its backup supply comes up
+ * halted.
+ */
+static int rtc_start(uint8_t sec)
+{
+        I2C_FIELD_SET(&sec, 0, DS1307_CH);
+        return i2c_wr_addr_byte(DS1307, DS1307_REG_SEC, sec);
+}
 
 void rtc_init(void)
 {
-        uint8_t rtc_reg[RTC_RAM_SIZE];
+        uint8_t rtc_reg[RTC_RAM_USER_SIZE];
+        uint8_t sec;
 
-        /* Clear the RTC RAM buffer */
-        memset(rtc_reg, 0, RTC_RAM_SIZE);
-        /* TODO: Clear the whole RTC RAM buffer with a block write */
-        i2c_wr_addr_blk(DS1307, RTC_REG_RAM_BUF_START, rtc_reg, RTC_RAM_SIZE);
+        /* Clear the user part of the RTC RAM, the rest is kept across
+         * resets (see the RAM map in rtc.h).
+         */
+        memset(rtc_reg, 0, RTC_RAM_USER_SIZE);
+        rtc_set_ram(RTC_RAM_USER, rtc_reg, RTC_RAM_USER_SIZE);
 
-        /* TODO: Start the RTC clock by writing '0' to RTC_REG_START_TIME */
-        i2c_wr_addr_byte(DS1307, RTC_REG_START_TIME, 0);
+        /* Start the RTC clock only if halted, the time survives MCU
+         * resets.
+         */
+        if (i2c_rd_addr_byte(DS1307, DS1307_REG_SEC, &sec))
+                i2c_wr_addr_byte(DS1307, DS1307_REG_SEC, 0);
+        else if (I2C_FIELD_GET(&sec, DS1307_CH))
+                rtc_start(sec);
 }
 
 void rtc_get_time_var(struct rtc_time_var *var)
 {
-        uint8_t sec, min;
-        uint8_t rtc_dat[2];
+        uint8_t regs[DS1307_NBR_REGS];
+
+        /* Read out the current RTC time, seconds and minutes in one burst */
+        I2C_REGS_RD(DS1307, regs, DS1307_SEC, DS1307_MIN);
+
+        var->sec_1 = I2C_FIELD_GET(regs, DS1307_SEC_1);
+        var->sec_10 = I2C_FIELD_GET(regs, DS1307_SEC_10);
+        var->min_1 = I2C_FIELD_GET(regs, DS1307_MIN_1);
+        var->min_10 = I2C_FIELD_GET(regs, DS1307_MIN_10);
+}
+
+int rtc_get_time(struct rtc_time *time)
+{
+        uint8_t regs[DS1307_NBR_REGS];
 
-        /* TODO: Read out current RTC time from the register RTC_REG_START_TIME,
-         * the register size is two bytes.
-         * RTC_REG_RAM_BUF_START. The block size is defined by "len".
+        /* All clock registers in one burst, the DS1307 latches them on START
+         * so they cannot roll over half-way.
          */
-        i2c_rd_addr_blk(DS1307, RTC_REG_START_TIME, rtc_dat, sizeof(rtc_dat));
-        sec = rtc_dat[0];
-        min = rtc_dat[1];
-
-        var->sec_1 = (sec & 0x0F);
-        var->sec_10 = ((sec & 0x70) >> 4);
-        var->min_1 = (min & 0x0F);
-        var->min_10 = ((min & 0x70) >> 4);
+        if (I2C_REGS_RD(DS1307, regs, DS1307_SEC, DS1307_YEAR))
+                return -1;
+        /* Started here without rtc_init(), e.g. with FAST_BOOT */
+        if (I2C_FIELD_GET(regs, DS1307_CH))
+                rtc_start(regs[DS1307_REG_SEC]);
+
+        time->sec = I2C_FIELD_GET_BCD(regs, DS1307_SEC);
+        time->min = I2C_FIELD_GET_BCD(regs, DS1307_MIN);
+        time->hour = I2C_FIELD_GET_BCD(regs, DS1307_HOUR);
+        time->wday = I2C_FIELD_GET(regs, DS1307_WDAY);
+        time->mday = I2C_FIELD_GET_BCD(regs, DS1307_MDAY);
+        time->mon = I2C_FIELD_GET_BCD(regs, DS1307_MON);
+        time->year = I2C_FIELD_GET_BCD(regs, DS1307_YEAR);
+        return 0;
+}
+
+/* Sets the time in 24-hour mode and starts the clock */
+int rtc_set_time(const struct rtc_time *time)
+{
+        uint8_t regs[DS1307_NBR_REGS];
+
+        memset(regs, 0, sizeof(regs));
+        I2C_FIELD_SET_BCD(regs, time->sec, DS1307_SEC);
+        I2C_FIELD_SET_BCD(regs, time->min, DS1307_MIN);
+        I2C_FIELD_SET_BCD(regs, time->hour, DS1307_HOUR);
+        I2C_FIELD_SET(regs, time->wday, DS1307_WDAY);
+        I2C_FIELD_SET_BCD(regs, time->mday, DS1307_MDAY);
+        I2C_FIELD_SET_BCD(regs, time->mon, DS1307_MON);
+        I2C_FIELD_SET_BCD(regs, time->year, DS1307_YEAR);
+        return I2C_REGS_WR(DS1307, regs, DS1307_SEC, DS1307_YEAR);
+}
+
+/* Seconds since 2000-01-01 00:00:00 */
+uint32_t rtc_mktime(const struct rtc_time *time)
+{
+        uint16_t days;
+
+        days = time->year * 365 + (time->year + 3) / 4;
+        days += rtc_yday[(time->mon - 1) % 12] + time->mday - 1;
+        if (time->year % 4 == 0 && time->mon > 2)
+                days++;
+        return ((uint32_t)days * 24 + time->hour) * 3600UL +
+                                time->min * 60U + time->sec;
+}
+
+int rtc_get_ram(uint8_t ofs, uint8_t *buf, uint8_t len)
+{
+        if (ofs + len > RTC_RAM_SIZE)
+                return -1;
+        return i2c_rd_addr_blk(DS1307, DS1307_REG_RAM + ofs, buf, len);
+}
+
+int rtc_set_ram(uint8_t ofs, uint8_t *buf, uint8_t len)
+{
+        if (ofs + len > RTC_RAM_SIZE)
+                return -1;
+        return i2c_wr_addr_blk(DS1307, DS1307_REG_RAM + ofs, buf, len);
 }
 
 int rtc_get_ram_buf(uint8_t *buf, uint8_t len)
 {
-        if (len >= RTC_RAM_SIZE)
+        if (len > RTC_RAM_USER_SIZE)
                 return -1;
-        /* TODO: Read out a block of data from RTC RAM starting from register
-         * RTC_REG_RAM_BUF_START. The block size is defined by "len".
-         */
-        return i2c_rd_addr_blk(DS1307, RTC_REG_RAM_BUF_START, buf, len);
+        return rtc_get_ram(RTC_RAM_USER, buf, len);
 }
 
 int rtc_set_ram_buf(uint8_t *buf, uint8_t len)
 {
-        if (len >= RTC_RAM_SIZE)
+        if (len > RTC_RAM_USER_SIZE)
                 return -1;
-        /* TODO: Write a block of data to RTC RAM starting from register
-         * RTC_REG_RAM_BUF_START. The block size is defined by "len".
-         */
-        return i2c_wr_addr_blk(DS1307, RTC_REG_RAM_BUF_START, buf, len);
+        return rtc_set_ram(RTC_RAM_USER, buf, len);
 }
\ No newline at end of file
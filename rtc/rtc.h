@@ -9,6 +9,29 @@
 #ifndef RTC_H_
 #define RTC_H_
 
+#include <stdint.h>
+
+
+/* RTC RAM map, offsets into the 56 byte battery-backed RAM */
+#define RTC_RAM_USER            (uint8_t)0      /* rtc_get/set_ram_buf() */
+#define RTC_RAM_USER_SIZE       (uint8_t)20
+#define RTC_RAM_ALARM           (uint8_t)20     /* alarm/alarm.c */
+#define RTC_RAM_ALARM_SIZE      (uint8_t)20
+#define RTC_RAM_LOG             (uint8_t)40     /* log/log.c, log_flush() */
+#define RTC_RAM_LOG_SIZE        (uint8_t)6
+#define RTC_RAM_FREE            (uint8_t)46
+#define RTC_RAM_FREE_SIZE       (uint8_t)10
+
+/* Calendar time, binary, 24-hour. Year 0-99 is 2000-2099 */
+struct rtc_time {
+        uint8_t sec;
+        uint8_t min;
+        uint8_t hour;
+        uint8_t wday;           /* 1-7 */
+        uint8_t mday;           /* 1-31 */
+        uint8_t mon;            /* 1-12 */
+        uint8_t year;
+};
 
 /* RTC time variable struct */
 struct rtc_time_var {
@@ -20,6 +43,11 @@ struct rtc_time_var {
 
 void rtc_init(void);
 void rtc_get_time_var(struct rtc_time_var *var);
+int rtc_get_time(struct rtc_time *time);
+int rtc_set_time(const struct rtc_time *time);
+uint32_t rtc_mktime(const struct rtc_time *time);
+int rtc_get_ram(uint8_t ofs, uint8_t *buf, uint8_t len);
+int rtc_set_ram(uint8_t ofs, uint8_t *buf, uint8_t len);
 int rtc_get_ram_buf(uint8_t *buf, uint8_t len);
 int rtc_set_ram_buf(uint8_t *buf, uint8_t len);
 
@@ -0,0 +1,288 @@
+/*
+ * sched.c
+ *
+ * Created: 2016-05-24
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include "../common.h"
+#include "../clock/clock.h"
+#include "../profile/profile.h"
+#include "../isr/ring.h"
+#include "../isr/snap.h"
+#include "sched.h"
+
+/* Event id of periodic tasks */
+#define SCHED_PERIODIC          (uint8_t)0xFF
+
+#define SCHED_TICKS_US(t)       ((t) / (CLOCK_HZ / 1000000UL))
+
+struct sched_task {
+        sched_handler_t handler;
+        uint8_t event;
+        uint16_t period;
+        uint16_t left;          /* Timer0 ticks to the next periodic run */
+        struct sched_stats stats;
+};
+
+struct sched_ev {
+        uint8_t event;
+        uint8_t arg;
+        uint32_t stamp;         /* clock_now32() when posted */
+};
+
+static struct sched_task sched_tasks[SCHED_MAX_TASKS];
+static uint8_t sched_nbr_tasks;
+
+/* The queue has a single consumer, sched_run(), and ISRs as producers.
+ * ISRs do not nest so they never race each other, main-line code posts
+ * through sched_post() which blocks interrupts.
+ */
+static struct sched_ev sched_queue[SCHED_QUEUE_LENGTH];
+static struct ring sched_ring;
+static volatile uint16_t sched_drops;
+
+/* Urgent event, valid while sched_urgent_set */
+static struct sched_ev sched_urgent;
+static volatile uint8_t sched_urgent_set;
+
+/* Timer0 ticks not yet handled and the time of the latest one */
+static volatile uint8_t sched_ticks;
+static volatile uint32_t sched_tick_stamp;
+
+void sched_init(void)
+{
+        sched_nbr_tasks = 0;
+        ring_init(&sched_ring);
+        sched_drops = 0;
+        sched_urgent_set = 0;
+        sched_ticks = 0;
+        set_sleep_mode(SLEEP_MODE_IDLE);
+}
+
+static int sched_add(uint8_t event, uint16_t period, sched_handler_t handler)
+{
+        struct sched_task *task;
+
+        if (sched_nbr_tasks == SCHED_MAX_TASKS || !handler)
+                return -1;
+        task = &sched_tasks[sched_nbr_tasks];
+        memset(task, 0, sizeof(*task));
+        task->handler = handler;
+        task->event = event;
+        task->period = period;
+        task->left = period;
+        return sched_nbr_tasks++;
+}
+
+/* Returns the task id, or -1 */
+int sched_add_event(uint8_t event, sched_handler_t handler)
+{
+        if (event == SCHED_PERIODIC)
+                return -1;
+        return sched_add(event, 0, handler);
+}
+
+/* Period in Timer0 ticks, returns the task id or -1 */
+int sched_add_periodic(uint16_t period, sched_handler_t handler)
+{
+        if (!period)
+                return -1;
+        return sched_add(SCHED_PERIODIC, period, handler);
+}
+
+/* From ISRs only, events are dropped (and counted) when the queue is full */
+void sched_post_isr(uint8_t event, uint8_t arg)
+{
+        struct sched_ev *ev;
+
+        if (ring_full(&sched_ring, SCHED_QUEUE_LENGTH)) {
+                sched_drops++;
+                return;
+        }
+        ev = &sched_queue[ring_put_idx(&sched_ring)];
+        ev->event = event;
+        ev->arg = arg;
+        ev->stamp = clock_now32_isr();
+        ring_put_commit(&sched_ring, SCHED_QUEUE_LENGTH);
+}
+
+void sched_post(uint8_t event, uint8_t arg)
+{
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                sched_post_isr(event, arg);
+        }
+}
+
+/* From ISRs only, the event runs next, before the periodic tasks and the
+ * queue. A second urgent event before that replaces the first.
+ */
+void sched_post_urgent_isr(uint8_t event, uint8_t arg)
+{
+        sched_urgent.event = event;
+        sched_urgent.arg = arg;
+        sched_urgent.stamp = clock_now32_isr();
+        sched_urgent_set = 1;
+}
+
+/* Called from the Timer0 overflow ISR */
+void sched_tick_isr(void)
+{
+        if (sched_ticks != 0xFF)
+                sched_ticks++;
+        sched_tick_stamp = clock_now32_isr();
+}
+
+static void sched_dispatch(struct sched_task *task, uint8_t arg,
+                                                        uint32_t stamp)
+{
+        struct sched_stats *stats = &task->stats;
+        uint32_t start, run;
+
+        start = clock_now32();
+        task->handler(arg);
+        run = clock_now32() - start;
+
+        stats->runs++;
+        stats->run_total += run;
+        if (run > stats->run_max)
+                stats->run_max = run;
+        if (start - stamp > stats->lat_max)
+                stats->lat_max = start - stamp;
+}
+
+static void sched_run_event(const struct sched_ev *ev)
+{
+        uint8_t i;
+
+        for (i = 0; i < sched_nbr_tasks; i++) {
+                if (sched_tasks[i].event == ev->event)
+                        sched_dispatch(&sched_tasks[i], ev->arg, ev->stamp);
+        }
+}
+
+/* Runs a posted urgent event. Called before every dispatch, so the event
+ * waits for the running task only.
+ */
+static void sched_run_urgent(void)
+{
+        struct sched_ev ev;
+
+        if (!sched_urgent_set)
+                return;
+        cli();
+        ev = sched_urgent;
+        sched_urgent_set = 0;
+        sei();
+        sched_run_event(&ev);
+}
+
+static void sched_run_periodic(uint8_t ticks, uint32_t stamp)
+{
+        struct sched_task *task;
+        uint8_t i;
+
+        for (i = 0; i < sched_nbr_tasks; i++) {
+                task = &sched_tasks[i];
+                if (task->event != SCHED_PERIODIC)
+                        continue;
+                if (task->left > ticks) {
+                        task->left -= ticks;
+                        continue;
+                }
+                /* Runs once even if several periods were missed, keeping
+                 * the phase.
+                 */
+                task->left = task->period -
+                                (ticks - task->left) % task->period;
+                sched_run_urgent();
+                sched_dispatch(task, 0, stamp);
+        }
+}
+
+void sched_run(void)
+{
+        struct sched_ev ev;
+        uint32_t stamp;
+#ifdef PROFILE
+        uint32_t start;
+#endif
+        uint8_t ticks;
+
+        while (1) {
+                cli();
+                if (sched_urgent_set) {
+                        ev = sched_urgent;
+                        sched_urgent_set = 0;
+                        sei();
+                        sched_run_event(&ev);
+                        continue;
+                }
+                if (ring_empty(&sched_ring) && !sched_ticks) {
+                        /* sei() takes effect after the next instruction, no
+                         * IRQ can slip in between the check and the sleep.
+                         */
+                        sleep_enable();
+                        sei();
+                        sleep_cpu();
+                        sleep_disable();
+                        continue;
+                }
+                ticks = sched_ticks;
+                sched_ticks = 0;
+                stamp = sched_tick_stamp;
+                sei();
+#ifdef PROFILE
+                start = clock_now32();
+                if (ticks)
+                        profile_add(PROFILE_JITTER, start - stamp);
+#endif
+
+                if (ticks)
+                        sched_run_periodic(ticks, stamp);
+
+                sched_run_urgent();
+                if (!ring_empty(&sched_ring)) {
+                        ev = sched_queue[ring_get_idx(&sched_ring)];
+                        ring_get_commit(&sched_ring, SCHED_QUEUE_LENGTH);
+                        sched_run_event(&ev);
+                }
+#ifdef PROFILE
+                profile_add(PROFILE_LOOP, clock_now32() - start);
+#endif
+        }
+}
+
+int sched_get_stats(uint8_t task, struct sched_stats *stats)
+{
+        if (task >= sched_nbr_tasks)
+                return -1;
+        *stats = sched_tasks[task].stats;
+        return 0;
+}
+
+/* Prints the statistics gathered since the previous call, times in us */
+void sched_print_stats(void)
+{
+        struct sched_stats *stats;
+        uint8_t i;
+
+        for (i = 0; i < sched_nbr_tasks; i++) {
+                stats = &sched_tasks[i].stats;
+                printf_P(PSTR("task %d: runs:%u run max:%lu avg:%lu "
+                                        "lat max:%lu\n"),
+                        i, stats->runs,
+                        (unsigned long)SCHED_TICKS_US(stats->run_max),
+                        (unsigned long)(stats->runs ? SCHED_TICKS_US(
+                                stats->run_total / stats->runs) : 0),
+                        (unsigned long)SCHED_TICKS_US(stats->lat_max));
+                memset(stats, 0, sizeof(*stats));
+        }
+        printf_P(PSTR("dropped events:%u\n"), snap_u16(&sched_drops));
+}
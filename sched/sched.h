@@ -0,0 +1,51 @@
+/*
+ * sched.h
+ *
+ * Description: Cooperative run-to-completion scheduler. ISRs post events
+ * into a queue consumed by sched_run(), which dispatches them to the event
+ * tasks and runs the periodic tasks on the Timer0 tick. The CPU sleeps in
+ * SLEEP_MODE_IDLE whenever nothing is pending.
+ *
+ * One urgent event, e.g. a power failure, can be posted from an ISR; it is
+ * dispatched as soon as the running task returns, ahead of any further
+ * periodic task and of the queue.
+ *
+ * Run time and wake-up latency (post or tick to dispatch) are measured per
+ * task in clock/clock.h ticks.
+ *
+ * Created: 2016-05-24
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <stdint.h>
+
+#define SCHED_MAX_TASKS         8
+/* Event queue length, power of two */
+#define SCHED_QUEUE_LENGTH      16
+
+/* Handler argument: the posted event argument, or 0 for periodic tasks */
+typedef void (*sched_handler_t)(uint8_t arg);
+
+struct sched_stats {
+        uint16_t runs;
+        uint32_t run_max;
+        uint32_t run_total;
+        uint32_t lat_max;
+};
+
+void sched_init(void);
+int sched_add_event(uint8_t event, sched_handler_t handler);
+int sched_add_periodic(uint16_t period, sched_handler_t handler);
+void sched_post_isr(uint8_t event, uint8_t arg);
+void sched_post(uint8_t event, uint8_t arg);
+void sched_post_urgent_isr(uint8_t event, uint8_t arg);
+void sched_tick_isr(void);
+void sched_run(void);
+int sched_get_stats(uint8_t task, struct sched_stats *stats);
+void sched_print_stats(void);
+
+#endif /* SCHED_H_ */
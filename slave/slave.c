@@ -0,0 +1,81 @@
+/*
+ * slave.c
+ *
+ * Description: I2C peripheral front end serving the register map in
+ * slave.h. Replies are zero-copy, the TWI slave transmitter is handed a
+ * pointer into the register map instead of copying it into its tx buffer.
+ *
+ * The map is triple buffered: the ISR hands out the live copy, the main
+ * loop fills a copy that is neither live nor possibly still being read by
+ * the host and then makes it live, so a host read never sees a half
+ * updated map.
+ *
+ * Created: 2016-05-02
+ * Author: alex.rodzevski@gmail.com
+ */
+#include <string.h>
+#include "slave.h"
+#include "../common.h"
+#include "../i2c/twi/twi.h"
+
+#ifdef APP_I2C_SLAVE
+
+static struct slave_regs regs[3];
+/* Copy served to the host */
+static volatile uint8_t regs_live;
+/* Copy last handed to the TWI slave transmitter */
+static volatile uint8_t regs_tx;
+/* Copy being filled between slave_regs_begin() and slave_regs_commit() */
+static uint8_t regs_wr;
+/* Register address written by the host */
+static volatile uint8_t reg_ptr;
+
+static void slave_on_rx(uint8_t *buf, int len)
+{
+        if (len > 0)
+                reg_ptr = buf[0];
+}
+
+static void slave_on_tx(void)
+{
+        uint8_t live = regs_live;
+        uint8_t ptr = reg_ptr;
+
+        if (ptr >= sizeof(struct slave_regs))
+                ptr = 0;
+        regs_tx = live;
+        twi_transmitDirect((uint8_t *)&regs[live] + ptr,
+                                        sizeof(struct slave_regs) - ptr);
+}
+
+void slave_init(uint8_t own_addr)
+{
+        memset(regs, 0, sizeof(regs));
+        regs_live = 0;
+        regs_tx = 0;
+        reg_ptr = 0;
+
+        twi_attachSlaveRxEvent(slave_on_rx);
+        twi_attachSlaveTxEvent(slave_on_tx);
+        twi_setAddress(own_addr);
+}
+
+struct slave_regs *slave_regs_begin(void)
+{
+        uint8_t live = regs_live;
+
+        /* Any copy but the live one and the one on the wire */
+        for (regs_wr = 0; regs_wr < 2; regs_wr++) {
+                if (regs_wr != live && regs_wr != regs_tx)
+                        break;
+        }
+        memcpy(&regs[regs_wr], &regs[live], sizeof(struct slave_regs));
+        return &regs[regs_wr];
+}
+
+void slave_regs_commit(void)
+{
+        regs_live = regs_wr;
+}
+
+#endif /* APP_I2C_SLAVE */
@@ -0,0 +1,34 @@
+/*
+ * slave.h
+ *
+ * Description: I2C peripheral front end. When the board is built with
+ * APP_I2C_SLAVE it answers on SLAVE_I2C_ADDR with a read-only register map
+ * served from RAM, so a host controller gets the current time, ADC value
+ * and log state in one transaction instead of driving the DS1307 and
+ * AT24C32 itself.
+ *
+ * Host access: write the register offset, then (repeated) START and read.
+ *
+ * Created: 2016-05-02
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef SLAVE_H_
+#define SLAVE_H_
+
+/* Register map, the register address is the byte offset in the struct */
+struct slave_regs {
+        uint8_t sec;            /* 0x00 RTC seconds, BCD */
+        uint8_t min;            /* 0x01 RTC minutes, BCD */
+        uint16_t adc_val;       /* 0x02 Latest ADC value, 10-bit, LSB first */
+        uint8_t adc_pct;        /* 0x04 Latest ADC value in percent */
+        uint16_t log_len;       /* 0x05 Bytes stored in the EEPROM log */
+        uint16_t log_size;      /* 0x07 EEPROM log capacity in bytes */
+};
+
+void slave_init(uint8_t own_addr);
+struct slave_regs *slave_regs_begin(void);
+void slave_regs_commit(void);
+
+#endif /* SLAVE_H_ */
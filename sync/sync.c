@@ -0,0 +1,195 @@
+/*
+ * sync.c
+ *
+ * Created: 2016-06-10
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <string.h>
+#include "../common.h"
+#include "../crc/crc16.h"
+#include "../eeprom/eeprom.h"
+#include "../uart/uart.h"
+#include "sync.h"
+
+/* Longest request payload, SYNC_REQ_PAGES */
+#define SYNC_REQ_MAX            3
+
+/* Request parser states */
+#define SYNC_ST_SOF             0
+#define SYNC_ST_TYPE            1
+#define SYNC_ST_LEN             2
+#define SYNC_ST_PAYLOAD         3
+#define SYNC_ST_CRC_HI          4
+#define SYNC_ST_CRC_LO          5
+
+static struct {
+        uint8_t state;
+        uint8_t type;
+        uint8_t len;
+        uint8_t pos;
+        uint8_t dat[SYNC_REQ_MAX];
+        uint16_t crc;
+} sync_in;
+
+/* Request being served, 0 if none */
+static uint8_t sync_job;
+static uint16_t sync_page;      /* Next page */
+static uint16_t sync_end;
+static uint16_t sync_pages;     /* In the EEPROM */
+/* Table response being filled */
+static uint8_t sync_out[SYNC_PAYLOAD_MAX];
+static uint8_t sync_fill;
+
+static void sync_send(uint8_t type, const uint8_t *dat, uint8_t len)
+{
+        uint16_t crc = CRC16_INIT;
+        uint8_t i;
+
+        uart0_transmit(SYNC_SOF);
+        uart0_transmit(type);
+        uart0_transmit(len);
+        crc = crc16_byte(crc, type);
+        crc = crc16_byte(crc, len);
+        for (i = 0; i < len; i++) {
+                uart0_transmit(dat[i]);
+                crc = crc16_byte(crc, dat[i]);
+        }
+        uart0_transmit(crc >> 8);
+        uart0_transmit(crc & 0xFF);
+}
+
+static void sync_error(uint8_t type)
+{
+        sync_job = 0;
+        sync_send(SYNC_RSP_ERROR, &type, 1);
+}
+
+static void sync_request(void)
+{
+        uint16_t count;
+
+        sync_pages = EEPROM_NBR_PAGES;
+        if (!sync_pages) {
+                sync_error(sync_in.type);
+                return;
+        }
+
+        switch (sync_in.type) {
+        case SYNC_REQ_TABLE:
+                sync_page = 0;
+                sync_end = sync_pages;
+                break;
+        case SYNC_REQ_PAGES:
+                if (sync_in.len != 3) {
+                        sync_error(sync_in.type);
+                        return;
+                }
+                sync_page = sync_in.dat[0] | (uint16_t)sync_in.dat[1] << 8;
+                count = sync_in.dat[2];
+                if (!count || sync_page + count > sync_pages) {
+                        sync_error(sync_in.type);
+                        return;
+                }
+                sync_end = sync_page + count;
+                break;
+        default:
+                sync_error(sync_in.type);
+                return;
+        }
+        /* A new request replaces the one being served */
+        sync_job = sync_in.type;
+        sync_fill = 0;
+}
+
+/* Feeds a received byte to the request parser */
+void sync_rx(uint8_t c)
+{
+        switch (sync_in.state) {
+        case SYNC_ST_SOF:
+                if (c == SYNC_SOF)
+                        sync_in.state = SYNC_ST_TYPE;
+                return;
+        case SYNC_ST_TYPE:
+                sync_in.type = c;
+                sync_in.crc = crc16_byte(CRC16_INIT, c);
+                sync_in.state = SYNC_ST_LEN;
+                return;
+        case SYNC_ST_LEN:
+                sync_in.len = c;
+                sync_in.pos = 0;
+                sync_in.crc = crc16_byte(sync_in.crc, c);
+                if (c > SYNC_REQ_MAX)
+                        sync_in.state = SYNC_ST_SOF;
+                else
+                        sync_in.state = c ? SYNC_ST_PAYLOAD : SYNC_ST_CRC_HI;
+                return;
+        case SYNC_ST_PAYLOAD:
+                sync_in.dat[sync_in.pos++] = c;
+                sync_in.crc = crc16_byte(sync_in.crc, c);
+                if (sync_in.pos == sync_in.len)
+                        sync_in.state = SYNC_ST_CRC_HI;
+                return;
+        case SYNC_ST_CRC_HI:
+                if (c != sync_in.crc >> 8) {
+                        sync_in.state = SYNC_ST_SOF;
+                        return;
+                }
+                sync_in.state = SYNC_ST_CRC_LO;
+                return;
+        default:
+                sync_in.state = SYNC_ST_SOF;
+                if (c == (sync_in.crc & 0xFF))
+                        sync_request();
+                return;
+        }
+}
+
+/* Whether a request is being served */
+uint8_t sync_pending(void)
+{
+        return sync_job != 0;
+}
+
+/* Reads the next page of the request being served and sends the response
+ * frames it completes, at most one of SYNC_FRAME_MAX bytes. Returns -1 on
+ * a bus error, the request is then dropped.
+ */
+int sync_step(void)
+{
+        uint8_t dat[2 + EEPROM_PAGE_SIZE];
+        uint16_t crc;
+
+        if (!sync_job)
+                return 0;
+        if (eeprom_get_data(sync_page * EEPROM_PAGE_SIZE, &dat[2],
+                                                        EEPROM_PAGE_SIZE)) {
+                sync_error(sync_job);
+                return -1;
+        }
+
+        if (sync_job == SYNC_REQ_PAGES) {
+                dat[0] = sync_page & 0xFF;
+                dat[1] = sync_page >> 8;
+                sync_send(SYNC_RSP_PAGE, dat, sizeof(dat));
+        } else {
+                if (!sync_fill) {
+                        sync_out[0] = sync_pages & 0xFF;
+                        sync_out[1] = sync_pages >> 8;
+                        sync_out[2] = sync_page & 0xFF;
+                        sync_out[3] = sync_page >> 8;
+                        sync_fill = 4;
+                }
+                crc = crc16_update(CRC16_INIT, &dat[2], EEPROM_PAGE_SIZE);
+                sync_out[sync_fill++] = crc & 0xFF;
+                sync_out[sync_fill++] = crc >> 8;
+                if (sync_fill == SYNC_PAYLOAD_MAX ||
+                    sync_page + 1 == sync_end) {
+                        sync_send(SYNC_RSP_TABLE, sync_out, sync_fill);
+                        sync_fill = 0;
+                }
+        }
+        if (++sync_page == sync_end)
+                sync_job = 0;
+        return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * sync.h
+ *
+ * Description: EEPROM mirror protocol on UART0, served to the host tool
+ * tools/eeprom_mirror. The host asks for the table of page CRCs, compares
+ * it with its image of the EEPROM and asks only for the pages that differ.
+ *
+ * Frames, in both directions: SYNC_SOF, type, payload length, payload and
+ * the CRC-16 (crc/crc16.h) of type, length and payload, big endian. The
+ * firmware sends each frame whole, in between the text output on the same
+ * UART. The host skips whatever is not a frame with a valid CRC.
+ *
+ * Requests (host):
+ *   SYNC_REQ_TABLE     no payload
+ *   SYNC_REQ_PAGES     first page, 16-bit LE, and number of pages
+ * Responses (firmware):
+ *   SYNC_RSP_TABLE     pages in the EEPROM and first page, 16-bit LE, then
+ *                      the CRCs of up to SYNC_TABLE_PAGES pages, 16-bit LE
+ *   SYNC_RSP_PAGE      page, 16-bit LE, and its EEPROM_PAGE_SIZE bytes
+ *   SYNC_RSP_ERROR     type of the failed request
+ *
+ * Each sync_step() reads one EEPROM page, so a table or page run is served
+ * over several scheduler runs.
+ *
+ * Created: 2016-06-10
+ * Author: alex.rodzevski@gmail.com
+ */
+
+
+#ifndef SYNC_H_
+#define SYNC_H_
+
+#include <stdint.h>
+
+#define SYNC_SOF                (uint8_t)0x7E
+#define SYNC_REQ_TABLE          (uint8_t)'T'
+#define SYNC_REQ_PAGES          (uint8_t)'P'
+#define SYNC_RSP_TABLE          (uint8_t)'t'
+#define SYNC_RSP_PAGE           (uint8_t)'p'
+#define SYNC_RSP_ERROR          (uint8_t)'e'
+
+#define SYNC_TABLE_PAGES        32
+#define SYNC_PAYLOAD_MAX        (4 + SYNC_TABLE_PAGES * 2)
+/* SOF, type, length, payload and CRC */
+#define SYNC_FRAME_MAX          (SYNC_PAYLOAD_MAX + 5)
+
+void sync_rx(uint8_t c);
+uint8_t sync_pending(void);
+int sync_step(void);
+
+#endif /* SYNC_H_ */
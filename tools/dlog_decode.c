@@ -0,0 +1,333 @@
+/*
+ * dlog_decode.c
+ *
+ * Description: Host-side decoder of the DLOG_PRINTF() frames (dlog/dlog.h)
+ * in a binary UART capture. The format strings are read from the flash
+ * image in the firmware's ELF file, at the address sent in each frame.
+ * Text output is passed through, the decoded lines are prefixed with the
+ * time since the first frame. Frames that do not check out (unknown
+ * address, bad sum, truncated) are shown as '?' and skipped.
+ *
+ * The ELF file must be the one of the firmware that produced the capture.
+ *
+ * Build:
+ *   gcc -o dlog_decode tools/dlog_decode.c
+ * Usage:
+ *   dlog_decode <elf> [<capture>]
+ *
+ * Created: 2016-06-07
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../common.h"
+
+/* Same as in clock/clock.h and dlog/dlog.h */
+#define CLOCK_PRESCALE          8
+#define DLOG_SYNC               0xA5
+#define DLOG_TS_SHIFT           7
+
+/* ELF32 little endian, only what is needed to find the flash sections */
+#define EI_NIDENT               16
+#define SHT_PROGBITS            1
+#define SHF_ALLOC               0x2
+/* AVR data space addresses are offset in the ELF file */
+#define AVR_DATA_OFFSET         0x800000UL
+
+struct elf_flash {
+        uint32_t addr;
+        uint32_t size;
+        const uint8_t *dat;
+};
+
+#define MAX_SECTIONS            16
+
+static struct elf_flash sections[MAX_SECTIONS];
+static int nbr_sections;
+
+static uint32_t rd32(const uint8_t *p)
+{
+        return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) |
+                                                ((uint32_t)p[3] << 24);
+}
+
+static uint16_t rd16(const uint8_t *p)
+{
+        return p[0] | (p[1] << 8);
+}
+
+/* Reads a whole file, or stdin if path is NULL */
+static uint8_t *load(const char *path, long *size)
+{
+        uint8_t *buf = NULL, *tmp;
+        long alloc = 0;
+        size_t n;
+        FILE *f;
+
+        f = path ? fopen(path, "rb") : stdin;
+        if (!f) {
+                perror(path);
+                return NULL;
+        }
+        *size = 0;
+        do {
+                if (*size == alloc) {
+                        alloc = alloc ? 2 * alloc : 65536;
+                        tmp = realloc(buf, alloc);
+                        if (!tmp) {
+                                free(buf);
+                                return NULL;
+                        }
+                        buf = tmp;
+                }
+                n = fread(&buf[*size], 1, alloc - *size, f);
+                *size += n;
+        } while (n);
+        if (path)
+                fclose(f);
+        return buf;
+}
+
+static int elf_parse(const uint8_t *elf, long size)
+{
+        uint32_t shoff, off, type, flags, addr, sh_size, sh_off;
+        uint16_t shentsize, shnum, i;
+
+        if (size < 52 || memcmp(elf, "\177ELF", 4) || elf[4] != 1 ||
+            elf[5] != 1) {
+                fprintf(stderr, "not a 32-bit little endian ELF file\n");
+                return -1;
+        }
+        shoff = rd32(&elf[32]);
+        shentsize = rd16(&elf[46]);
+        shnum = rd16(&elf[48]);
+        for (i = 0; i < shnum; i++) {
+                off = shoff + i * shentsize;
+                if (off + 40 > size)
+                        return -1;
+                type = rd32(&elf[off + 4]);
+                flags = rd32(&elf[off + 8]);
+                addr = rd32(&elf[off + 12]);
+                sh_off = rd32(&elf[off + 16]);
+                sh_size = rd32(&elf[off + 20]);
+                if (type != SHT_PROGBITS || !(flags & SHF_ALLOC) ||
+                    addr >= AVR_DATA_OFFSET || sh_off + sh_size > size)
+                        continue;
+                if (nbr_sections == MAX_SECTIONS)
+                        break;
+                sections[nbr_sections].addr = addr;
+                sections[nbr_sections].size = sh_size;
+                sections[nbr_sections].dat = &elf[sh_off];
+                nbr_sections++;
+        }
+        return nbr_sections ? 0 : -1;
+}
+
+/* NUL-terminated string at a flash address, or NULL */
+static const char *elf_str(uint32_t addr)
+{
+        const struct elf_flash *s;
+        int i;
+
+        for (i = 0; i < nbr_sections; i++) {
+                s = &sections[i];
+                if (addr < s->addr || addr >= s->addr + s->size)
+                        continue;
+                if (!memchr(&s->dat[addr - s->addr], '\0',
+                                                s->addr + s->size - addr))
+                        return NULL;
+                return (const char *)&s->dat[addr - s->addr];
+        }
+        return NULL;
+}
+
+struct frame {
+        const uint8_t *p;
+        const uint8_t *end;
+        uint8_t sum;
+        int err;
+};
+
+static uint8_t frame_byte(struct frame *fr)
+{
+        if (fr->p >= fr->end) {
+                fr->err = 1;
+                return 0;
+        }
+        fr->sum += *fr->p;
+        return *fr->p++;
+}
+
+static uint32_t frame_varint(struct frame *fr)
+{
+        uint32_t v = 0;
+        uint8_t b, shift = 0;
+
+        do {
+                b = frame_byte(fr);
+                if (shift < 32)
+                        v |= (uint32_t)(b & 0x7F) << shift;
+                shift += 7;
+        } while ((b & 0x80) && !fr->err);
+        return v;
+}
+
+/* Decodes the frame following the DLOG_SYNC at fr->p into out, returns
+ * the timestamp delta or -1 if it does not check out.
+ */
+static long frame_decode(struct frame *fr, char *out, size_t out_size)
+{
+        char spec[32], str[256], *o = out;
+        const char *fmt, *start;
+        uint32_t delta, v;
+        size_t n, left;
+        uint8_t is_long;
+        int32_t sv;
+        char c;
+
+        if (fr->end - fr->p < 2)
+                return -1;
+        fmt = elf_str(rd16(fr->p));
+        if (!fmt)
+                return -1;
+        frame_byte(fr);
+        frame_byte(fr);
+        delta = frame_varint(fr);
+
+#define OUT(...) do { \
+                left = out_size - (o - out); \
+                n = snprintf(o, left, __VA_ARGS__); \
+                o += n < left ? n : left - 1; \
+        } while (0)
+
+        while ((c = *fmt++) && !fr->err) {
+                if (c != '%') {
+                        OUT("%c", c);
+                        continue;
+                }
+                /* The spec up to the length modifiers, the host conversion
+                 * is always a long one.
+                 */
+                start = fmt - 1;
+                while (*fmt && strchr("-+ #0123456789.", *fmt))
+                        fmt++;
+                n = fmt - start;
+                if (n >= sizeof(spec) - 3)
+                        return -1;
+                memcpy(spec, start, n);
+                is_long = 0;
+                while (*fmt == 'l' || *fmt == 'h') {
+                        if (*fmt == 'l')
+                                is_long = 1;
+                        fmt++;
+                }
+                c = *fmt;
+                if (!c)
+                        break;
+                fmt++;
+                switch (c) {
+                case 'd':
+                case 'i':
+                        v = frame_varint(fr);
+                        sv = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+                        strcpy(&spec[n], "ld");
+                        OUT(spec, (long)sv);
+                        break;
+                case 'u':
+                case 'x':
+                case 'X':
+                case 'o':
+                        v = frame_varint(fr);
+                        if (!is_long)
+                                v &= 0xFFFF;
+                        sprintf(&spec[n], "l%c", c);
+                        OUT(spec, (unsigned long)v);
+                        break;
+                case 'p':
+                        OUT("0x%04x", (unsigned int)frame_varint(fr));
+                        break;
+                case 'c':
+                        strcpy(&spec[n], "c");
+                        OUT(spec, (int)frame_varint(fr));
+                        break;
+                case 's':
+                case 'S':
+                        for (left = 0; (str[left] = frame_byte(fr)); left++) {
+                                if (left == sizeof(str) - 1)
+                                        return -1;
+                        }
+                        strcpy(&spec[n], "s");
+                        OUT(spec, str);
+                        break;
+                case '%':
+                        OUT("%%");
+                        break;
+                default:
+                        return -1;
+                }
+        }
+#undef OUT
+        if (fr->err)
+                return -1;
+        v = fr->sum;
+        if (frame_byte(fr) != (uint8_t)v || fr->err)
+                return -1;
+        return delta;
+}
+
+int main(int argc, char *argv[])
+{
+        static char line[4096];
+        const uint8_t *cap, *p, *end;
+        struct frame fr;
+        uint64_t ticks = 0;
+        long elf_size, cap_size, delta;
+        uint8_t *elf;
+        int bol = 1;
+
+        if (argc < 2 || argc > 3) {
+                fprintf(stderr, "usage: dlog_decode <elf> [<capture>]\n");
+                return 1;
+        }
+        elf = load(argv[1], &elf_size);
+        if (!elf || elf_parse(elf, elf_size))
+                return 1;
+        cap = load(argc == 3 ? argv[2] : NULL, &cap_size);
+        if (!cap)
+                return 1;
+
+        p = cap;
+        end = cap + cap_size;
+        while (p < end) {
+                if (*p != DLOG_SYNC) {
+                        if (*p != '\r') {
+                                putchar(*p);
+                                bol = *p == '\n';
+                        }
+                        p++;
+                        continue;
+                }
+                memset(&fr, 0, sizeof(fr));
+                fr.p = p + 1;
+                fr.end = end;
+                delta = frame_decode(&fr, line, sizeof(line));
+                if (delta < 0) {
+                        putchar('?');
+                        p++;
+                        continue;
+                }
+                ticks += (uint64_t)delta << DLOG_TS_SHIFT;
+                if (!bol)
+                        putchar('\n');
+                printf("[%12.6f] %s", ticks * (double)CLOCK_PRESCALE / F_CPU,
+                                                                        line);
+                bol = line[0] && line[strlen(line) - 1] == '\n';
+                p = fr.p;
+        }
+        if (!bol)
+                putchar('\n');
+        return 0;
+}
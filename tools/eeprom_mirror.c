@@ -0,0 +1,299 @@
+/*
+ * eeprom_mirror.c
+ *
+ * Description: Host-side EEPROM mirror, keeps an image file of a board's
+ * EEPROM up to date over the UART with the sync protocol (sync/sync.h,
+ * EEPROM_SYNC in common.h). The page CRC table of the board is compared
+ * with the CRCs of the memory-mapped image and only the pages that differ
+ * are fetched and written in place, so syncing a mostly unchanged EEPROM
+ * costs the table and a few pages. The first sync fetches every page.
+ *
+ * Bytes that are not part of a valid frame, e.g. the firmware's text
+ * output, are skipped.
+ *
+ * Build:
+ *   gcc -o eeprom_mirror tools/eeprom_mirror.c crc/crc16.c
+ * Usage:
+ *   eeprom_mirror <tty> <image>
+ * Against the simulated board, see tools/sync_sim.c:
+ *   ./sync_sim &
+ *   ./eeprom_mirror /dev/pts/N board.img
+ *
+ * Created: 2016-06-10
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../common.h"
+#include "../crc/crc16.h"
+#include "../eeprom/eeprom.h"
+#include "../sync/sync.h"
+
+/* Wait for a response frame, the firmware reads one page per task run */
+#define MIRROR_TIMEOUT_MS       2000
+#define MIRROR_RETRIES          3
+/* Largest page count of a SYNC_REQ_PAGES request */
+#define MIRROR_RUN_MAX          255
+
+struct frame {
+        uint8_t type;
+        uint8_t len;
+        uint8_t dat[255];
+};
+
+static int tty_fd = -1;
+static unsigned long tx_bytes, rx_bytes;
+
+static int tty_open(const char *path)
+{
+        struct termios tio;
+
+        tty_fd = open(path, O_RDWR | O_NOCTTY);
+        if (tty_fd < 0) {
+                perror(path);
+                return -1;
+        }
+        if (tcgetattr(tty_fd, &tio) == 0) {
+                cfmakeraw(&tio);
+                cfsetispeed(&tio, B9600);
+                cfsetospeed(&tio, B9600);
+                tcsetattr(tty_fd, TCSANOW, &tio);
+        }
+        tcflush(tty_fd, TCIFLUSH);
+        return 0;
+}
+
+static int tty_getc(uint8_t *c)
+{
+        struct pollfd pfd = { tty_fd, POLLIN, 0 };
+
+        if (poll(&pfd, 1, MIRROR_TIMEOUT_MS) <= 0)
+                return -1;
+        if (read(tty_fd, c, 1) != 1)
+                return -1;
+        rx_bytes++;
+        return 0;
+}
+
+static int frame_send(uint8_t type, const uint8_t *dat, uint8_t len)
+{
+        uint8_t buf[5 + 255];
+        uint16_t crc;
+
+        buf[0] = SYNC_SOF;
+        buf[1] = type;
+        buf[2] = len;
+        memcpy(&buf[3], dat, len);
+        crc = crc16_update(CRC16_INIT, &buf[1], 2 + len);
+        buf[3 + len] = crc >> 8;
+        buf[4 + len] = crc & 0xFF;
+        if (write(tty_fd, buf, 5 + len) != 5 + len)
+                return -1;
+        tx_bytes += 5 + len;
+        return 0;
+}
+
+/* Next frame with a valid CRC, returns -1 on a timeout. A bad frame is
+ * rescanned from its second byte, it may have been text containing SOF.
+ */
+static int frame_recv(struct frame *f)
+{
+        uint8_t raw[5 + 255];
+        uint16_t crc;
+        int len = 0, i;
+
+        while (1) {
+                if (len == 0) {
+                        if (tty_getc(&raw[0]))
+                                return -1;
+                        if (raw[0] != SYNC_SOF)
+                                continue;
+                        len = 1;
+                }
+                while (len < 3 || len < 5 + raw[2]) {
+                        if (tty_getc(&raw[len]))
+                                return -1;
+                        len++;
+                }
+                crc = crc16_update(CRC16_INIT, &raw[1], 2 + raw[2]);
+                if (raw[3 + raw[2]] == crc >> 8 &&
+                    raw[4 + raw[2]] == (crc & 0xFF)) {
+                        f->type = raw[1];
+                        f->len = raw[2];
+                        memcpy(f->dat, &raw[3], f->len);
+                        return 0;
+                }
+                /* Resync on the next SOF within the bytes read */
+                for (i = 1; i < len && raw[i] != SYNC_SOF; i++)
+                        ;
+                memmove(raw, &raw[i], len - i);
+                len -= i;
+        }
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+        return p[0] | (uint16_t)p[1] << 8;
+}
+
+/* Fetches the page CRC table, returns the number of pages or -1 */
+static int table_get(uint16_t **table)
+{
+        struct frame f;
+        uint16_t pages = 0, first, got = 0;
+        int i, n;
+
+        if (frame_send(SYNC_REQ_TABLE, NULL, 0))
+                return -1;
+        *table = NULL;
+        while (!*table || got < pages) {
+                if (frame_recv(&f))
+                        break;
+                if (f.type == SYNC_RSP_ERROR)
+                        break;
+                if (f.type != SYNC_RSP_TABLE || f.len < 4 || f.len & 1)
+                        continue;
+                if (!*table) {
+                        pages = get16(f.dat);
+                        *table = calloc(pages, sizeof(**table));
+                        if (!*table || !pages)
+                                break;
+                }
+                first = get16(&f.dat[2]);
+                n = (f.len - 4) / 2;
+                if (first != got || first + n > pages)
+                        break;
+                for (i = 0; i < n; i++)
+                        (*table)[first + i] = get16(&f.dat[4 + i * 2]);
+                got += n;
+        }
+        if (*table && pages && got == pages)
+                return pages;
+        free(*table);
+        *table = NULL;
+        return -1;
+}
+
+/* Fetches count pages from first into the image */
+static int pages_get(uint8_t *img, const uint16_t *table, uint16_t first,
+                                                        uint8_t count)
+{
+        struct frame f;
+        uint8_t req[3];
+        uint16_t page, crc;
+        int i;
+
+        req[0] = first & 0xFF;
+        req[1] = first >> 8;
+        req[2] = count;
+        if (frame_send(SYNC_REQ_PAGES, req, sizeof(req)))
+                return -1;
+        for (i = 0; i < count; ) {
+                if (frame_recv(&f) || f.type == SYNC_RSP_ERROR)
+                        return -1;
+                if (f.type != SYNC_RSP_PAGE ||
+                    f.len != 2 + EEPROM_PAGE_SIZE)
+                        continue;
+                page = get16(f.dat);
+                if (page != first + i)
+                        return -1;
+                crc = crc16_update(CRC16_INIT, &f.dat[2], EEPROM_PAGE_SIZE);
+                if (crc != table[page])
+                        printf("page %u changed during the sync\n", page);
+                memcpy(&img[page * EEPROM_PAGE_SIZE], &f.dat[2],
+                                                        EEPROM_PAGE_SIZE);
+                i++;
+        }
+        return 0;
+}
+
+static int mirror(const char *path)
+{
+        uint16_t *table = NULL;
+        uint8_t *img;
+        size_t size;
+        int fd, pages, page, run, tries, changed = 0, ret = -1;
+
+        for (tries = 0; tries < MIRROR_RETRIES; tries++) {
+                pages = table_get(&table);
+                if (pages > 0)
+                        break;
+        }
+        if (pages <= 0) {
+                fprintf(stderr, "no page table\n");
+                return -1;
+        }
+
+        fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+                perror(path);
+                free(table);
+                return -1;
+        }
+        size = (size_t)pages * EEPROM_PAGE_SIZE;
+        if (ftruncate(fd, size)) {
+                perror(path);
+                goto out_close;
+        }
+        img = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (img == MAP_FAILED) {
+                perror(path);
+                goto out_close;
+        }
+
+        for (page = 0; page < pages; page += run) {
+                run = 0;
+                while (page + run < pages && run < MIRROR_RUN_MAX &&
+                       crc16_update(CRC16_INIT,
+                                &img[(page + run) * EEPROM_PAGE_SIZE],
+                                EEPROM_PAGE_SIZE) != table[page + run])
+                        run++;
+                if (!run) {
+                        run = 1;
+                        continue;
+                }
+                for (tries = 0; tries < MIRROR_RETRIES; tries++) {
+                        if (pages_get(img, table, page, run) == 0)
+                                break;
+                }
+                if (tries == MIRROR_RETRIES) {
+                        fprintf(stderr, "pages %d-%d failed\n", page,
+                                                        page + run - 1);
+                        goto out_unmap;
+                }
+                changed += run;
+        }
+        ret = 0;
+        printf("%s: %d pages, %d synced, %lu bytes received, %lu sent\n",
+                                path, pages, changed, rx_bytes, tx_bytes);
+out_unmap:
+        msync(img, size, MS_SYNC);
+        munmap(img, size);
+out_close:
+        close(fd);
+        free(table);
+        return ret;
+}
+
+int main(int argc, char *argv[])
+{
+        int ret;
+
+        if (argc != 3) {
+                fprintf(stderr, "usage: eeprom_mirror <tty> <image>\n");
+                return 1;
+        }
+        if (tty_open(argv[1]))
+                return 1;
+        ret = mirror(argv[2]);
+        close(tty_fd);
+        return ret ? 2 : 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * isr_check.c
+ *
+ * Description: Host-side check of the ISR shared data helpers, isr/ring.h
+ * and isr/snap.h. The ring indices are run against a reference queue with
+ * random puts and gets for each supported length class, then a producer
+ * and a consumer thread stand in for an ISR and the main loop and pass a
+ * numbered sequence through a small ring. The snapshots are read while a
+ * thread keeps counting, every read has to be monotonic. Prints a line per
+ * check and exits non-zero on the first failure.
+ *
+ * Build:
+ *   gcc -O2 -pthread -o isr_check tools/isr_check.c
+ * Usage:
+ *   isr_check
+ *
+ * Created: 2016-06-10
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../isr/ring.h"
+#include "../isr/snap.h"
+
+#define CHECK_MODEL_OPS         1000000
+#define CHECK_SPSC_LENGTH       16
+#define CHECK_SPSC_ITEMS        200000UL
+#define CHECK_SNAP_READS        1000000
+
+/* Ring against a plain array queue of the same capacity */
+static int check_model(uint16_t len)
+{
+        uint8_t buf[256], ref[256];
+        unsigned int ref_head = 0, ref_tail = 0, n;
+        struct ring r;
+        uint8_t data;
+        long i;
+
+        ring_init(&r);
+        srand(len);
+        for (i = 0; i < CHECK_MODEL_OPS; i++) {
+                n = ref_head - ref_tail;
+                if (ring_count(&r, len) != n ||
+                    ring_free(&r, len) != len - 1 - n ||
+                    ring_empty(&r) != (n == 0) ||
+                    ring_full(&r, len) != (n == len - 1U)) {
+                        printf("model %u: state differs at op %ld\n", len, i);
+                        return -1;
+                }
+                if (rand() & 1) {
+                        if (ring_full(&r, len))
+                                continue;
+                        data = (uint8_t)i;
+                        buf[ring_put_idx(&r)] = data;
+                        ring_put_commit(&r, len);
+                        ref[ref_head++ % len] = data;
+                } else {
+                        if (ring_empty(&r))
+                                continue;
+                        data = buf[ring_get_idx(&r)];
+                        ring_get_commit(&r, len);
+                        if (data != ref[ref_tail++ % len]) {
+                                printf("model %u: data differs at op %ld\n",
+                                                                len, i);
+                                return -1;
+                        }
+                }
+        }
+        printf("model %u: ok\n", len);
+        return 0;
+}
+
+static uint32_t spsc_buf[CHECK_SPSC_LENGTH];
+static struct ring spsc_ring;
+
+/* The ISR side, yields rather than spins as the host may have one core */
+static void *spsc_producer(void *unused)
+{
+        uint32_t i = 0;
+
+        (void)unused;
+        while (i < CHECK_SPSC_ITEMS) {
+                if (ring_full(&spsc_ring, CHECK_SPSC_LENGTH)) {
+                        sched_yield();
+                        continue;
+                }
+                spsc_buf[ring_put_idx(&spsc_ring)] = i++;
+                ring_put_commit(&spsc_ring, CHECK_SPSC_LENGTH);
+        }
+        return NULL;
+}
+
+static int check_spsc(void)
+{
+        pthread_t thread;
+        uint32_t i = 0, data;
+        int ret = 0;
+
+        ring_init(&spsc_ring);
+        if (pthread_create(&thread, NULL, spsc_producer, NULL))
+                return -1;
+        while (i < CHECK_SPSC_ITEMS) {
+                if (ring_empty(&spsc_ring)) {
+                        sched_yield();
+                        continue;
+                }
+                data = spsc_buf[ring_get_idx(&spsc_ring)];
+                ring_get_commit(&spsc_ring, CHECK_SPSC_LENGTH);
+                if (data != i++ && !ret) {
+                        printf("spsc: got %lu, expected %lu\n",
+                                (unsigned long)data, (unsigned long)i - 1);
+                        ret = -1;
+                }
+        }
+        pthread_join(thread, NULL);
+        if (!ret)
+                printf("spsc: %lu items ok\n", CHECK_SPSC_ITEMS);
+        return ret;
+}
+
+static volatile uint32_t snap_count32;
+static volatile uint16_t snap_count16;
+static volatile int snap_stop;
+
+static void *snap_writer(void *unused)
+{
+        (void)unused;
+        while (!snap_stop) {
+                snap_count32++;
+                /* Saturates, so that every read is monotonic */
+                if (snap_count16 != 0xFFFF)
+                        snap_count16++;
+        }
+        return NULL;
+}
+
+static int check_snap(void)
+{
+        pthread_t thread;
+        uint32_t val32, last32 = 0;
+        uint16_t val16, last16 = 0;
+        int i, ret = 0;
+
+        if (pthread_create(&thread, NULL, snap_writer, NULL))
+                return -1;
+        for (i = 0; i < CHECK_SNAP_READS && !ret; i++) {
+                val32 = snap_u32(&snap_count32);
+                val16 = snap_u16(&snap_count16);
+                if (val32 < last32 || val16 < last16) {
+                        printf("snap: read %lu/%u after %lu/%u\n",
+                                        (unsigned long)val32, val16,
+                                        (unsigned long)last32, last16);
+                        ret = -1;
+                }
+                last32 = val32;
+                last16 = val16;
+        }
+        snap_stop = 1;
+        pthread_join(thread, NULL);
+        if (!ret)
+                printf("snap: %d reads ok\n", CHECK_SNAP_READS);
+        return ret;
+}
+
+int main(void)
+{
+        static const uint16_t lengths[] = { 2, 16, 128, 256 };
+        unsigned int i;
+
+        for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+                if (check_model(lengths[i]))
+                        return 2;
+        }
+        if (check_spsc() || check_snap())
+                return 2;
+        return 0;
+}
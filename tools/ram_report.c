@@ -0,0 +1,118 @@
+/*
+ * ram_report.c
+ *
+ * Description: Host-side static RAM report per module (object file), from
+ * the symbol sizes listed by nm. Works on the AVR objects of the firmware
+ * build as well as on the host build objects (with nm), e.g.
+ *
+ *   find Debug -name '*.o' | xargs avr-nm -S -A | ./ram_report
+ *   nm -S -A i2c.o rtc.o eeprom.o | ./ram_report
+ *
+ * Initialized data (d/D) and zeroed data (b/B, and common symbols) are
+ * summed separately, the largest symbol of each module is listed as well.
+ *
+ * Build:
+ *   gcc -o ram_report tools/ram_report.c
+ *
+ * Created: 2016-06-03
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_MODULES             64
+#define MAX_NAME                64
+
+struct module {
+        char name[MAX_NAME];
+        unsigned long data;
+        unsigned long bss;
+        unsigned long top_size;
+        char top[MAX_NAME];
+};
+
+static struct module modules[MAX_MODULES];
+static int nbr_modules;
+
+static struct module *module_get(const char *name)
+{
+        int i;
+
+        for (i = 0; i < nbr_modules; i++) {
+                if (!strcmp(modules[i].name, name))
+                        return &modules[i];
+        }
+        if (nbr_modules == MAX_MODULES)
+                return NULL;
+        strncpy(modules[nbr_modules].name, name, MAX_NAME - 1);
+        return &modules[nbr_modules++];
+}
+
+static int module_cmp(const void *a, const void *b)
+{
+        const struct module *ma = a, *mb = b;
+        unsigned long ta = ma->data + ma->bss, tb = mb->data + mb->bss;
+
+        return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+int main(void)
+{
+        char line[256], file[MAX_NAME], sym[MAX_NAME], type;
+        unsigned long addr, size, data = 0, bss = 0;
+        struct module *m;
+        char *colon;
+        int i;
+
+        while (fgets(line, sizeof(line), stdin)) {
+                /* "<file>:<addr> <size> <type> <name>", symbols without a
+                 * size have no size field and are skipped.
+                 */
+                colon = strrchr(line, ':');
+                if (!colon || colon - line >= MAX_NAME)
+                        continue;
+                if (sscanf(colon + 1, "%lx %lx %c %63s", &addr, &size, &type,
+                                                                sym) != 4)
+                        continue;
+                memcpy(file, line, colon - line);
+                file[colon - line] = '\0';
+
+                switch (type) {
+                case 'd':
+                case 'D':
+                        m = module_get(file);
+                        if (m)
+                                m->data += size;
+                        break;
+                case 'b':
+                case 'B':
+                case 'C':
+                        m = module_get(file);
+                        if (m)
+                                m->bss += size;
+                        break;
+                default:
+                        continue;
+                }
+                if (m && size > m->top_size) {
+                        m->top_size = size;
+                        strcpy(m->top, sym);
+                }
+        }
+
+        qsort(modules, nbr_modules, sizeof(modules[0]), module_cmp);
+        printf("%-32s %6s %6s %6s  %s\n", "module", "data", "bss", "total",
+                                                        "largest");
+        for (i = 0; i < nbr_modules; i++) {
+                m = &modules[i];
+                printf("%-32s %6lu %6lu %6lu  %s (%lu)\n", m->name, m->data,
+                                m->bss, m->data + m->bss, m->top,
+                                m->top_size);
+                data += m->data;
+                bss += m->bss;
+        }
+        printf("%-32s %6lu %6lu %6lu\n", "total", data, bss, data + bss);
+        return 0;
+}
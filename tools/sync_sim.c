@@ -0,0 +1,168 @@
+/*
+ * sync_sim.c
+ *
+ * Description: Serves the EEPROM sync protocol (sync/sync.c) on a pseudo
+ * terminal, with the simulated bus behind the eeprom driver, to test
+ * tools/eeprom_mirror without a board. The slave side of the pty is
+ * printed at start-up. The EEPROM starts erased, or with the contents of
+ * an image file. Commands on stdin change it in between syncs:
+ *
+ *   write <addr> <text>        write text to the EEPROM
+ *   fill <page> <byte>         fill a page with a byte value (hex)
+ *
+ * With -n a line of text is sent in between the frames every few pages,
+ * as the firmware's output would be.
+ *
+ * Build:
+ *   gcc -DI2C_BACKEND_SIM -o sync_sim tools/sync_sim.c sync/sync.c \
+ *           eeprom/eeprom.c crc/crc16.c i2c/i2c.c i2c/sim/i2c_sim.c
+ * Usage:
+ *   sync_sim [-n] [<image>]
+ *
+ * Created: 2016-06-10
+ * Author: alex.rodzevski@gmail.com
+ */
+
+/* posix_openpt() and cfmakeraw() */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "../common.h"
+#include "../i2c/i2c.h"
+#include "../i2c/sim/i2c_sim.h"
+#include "../eeprom/eeprom.h"
+#include "../uart/uart.h"
+#include "../sync/sync.h"
+
+/* Pages served between two noise lines with -n */
+#define SIM_NOISE_PAGES         8
+
+static int pty_fd = -1;
+
+/* UART driver stand-ins, used by sync.c */
+void uart0_transmit(unsigned char data)
+{
+        if (write(pty_fd, &data, 1) != 1)
+                perror("pty");
+}
+
+static int pty_open(void)
+{
+        struct termios tio;
+        const char *name;
+        int slave;
+
+        pty_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (pty_fd < 0 || grantpt(pty_fd) || unlockpt(pty_fd)) {
+                perror("pty");
+                return -1;
+        }
+        name = ptsname(pty_fd);
+        /* Kept open, raw, so the line discipline passes the frames as they
+         * are and the master does not hang up between two clients.
+         */
+        slave = open(name, O_RDWR | O_NOCTTY);
+        if (slave < 0 || tcgetattr(slave, &tio)) {
+                perror(name);
+                return -1;
+        }
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+        printf("%s\n", name);
+        fflush(stdout);
+        return 0;
+}
+
+static int image_load(const char *path)
+{
+        uint8_t *eeprom = i2c_sim_eeprom(0);
+        FILE *f;
+        size_t len;
+
+        f = fopen(path, "rb");
+        if (!f) {
+                perror(path);
+                return -1;
+        }
+        len = fread(eeprom, 1, I2C_SIM_EEPROMS * EEPROM_DEV_SIZE, f);
+        fclose(f);
+        printf("loaded %zu bytes\n", len);
+        return 0;
+}
+
+static void command(char *line)
+{
+        uint8_t page[EEPROM_PAGE_SIZE];
+        char text[128];
+        unsigned int addr, val;
+
+        if (sscanf(line, "write %u %127s", &addr, text) == 2) {
+                if (eeprom_set_data(addr, (uint8_t *)text, strlen(text)))
+                        printf("write failed\n");
+        } else if (sscanf(line, "fill %u %x", &addr, &val) == 2) {
+                memset(page, val, sizeof(page));
+                if (eeprom_set_data(addr * EEPROM_PAGE_SIZE, page,
+                                                        sizeof(page)))
+                        printf("fill failed\n");
+        } else {
+                printf("write <addr> <text> | fill <page> <byte>\n");
+        }
+        fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+        struct pollfd pfd[2];
+        char line[160];
+        uint8_t buf[64];
+        int noise = 0, steps = 0, argi = 1;
+        ssize_t n, i;
+
+        if (argi < argc && strcmp(argv[argi], "-n") == 0) {
+                noise = 1;
+                argi++;
+        }
+        i2c_init();
+        if (argi < argc && image_load(argv[argi]))
+                return 1;
+        if (pty_open())
+                return 1;
+
+        /* Unbuffered, so poll() sees each command line */
+        setvbuf(stdin, NULL, _IONBF, 0);
+        pfd[0].fd = pty_fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = STDIN_FILENO;
+        pfd[1].events = POLLIN;
+        while (1) {
+                /* Serve a page at a time, as the sync task does */
+                while (sync_pending()) {
+                        sync_step();
+                        if (noise && ++steps % SIM_NOISE_PAGES == 0 &&
+                            write(pty_fd, "Logged 00:00.000 - 42%\r\n",
+                                                        24) != 24)
+                                perror("pty");
+                        if (poll(pfd, 1, 0) > 0)
+                                break;
+                }
+                if (poll(pfd, 2, -1) < 0)
+                        break;
+                if (pfd[0].revents & POLLIN) {
+                        n = read(pty_fd, buf, sizeof(buf));
+                        for (i = 0; i < n; i++)
+                                sync_rx(buf[i]);
+                }
+                if (pfd[1].revents & (POLLIN | POLLHUP)) {
+                        if (!fgets(line, sizeof(line), stdin))
+                                pfd[1].fd = -1;
+                        else
+                                command(line);
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * tinyrtc.c
+ *
+ * Description: Host-side command line tool running the firmware's rtc and
+ * eeprom drivers against a Tiny RTC board on a Linux I2C adapter, or
+ * against the simulated bus. The commands are run in order, e.g.
+ *
+ *   tinyrtc init time write 0 hello read 0 5
+ *
+ * Build (Linux i2c-dev, adapter in I2C_DEV, default /dev/i2c-1):
+ *   gcc -DI2C_BACKEND_LINUX -o tinyrtc tools/tinyrtc.c i2c/i2c.c \
+ *           i2c/linux/i2c_linux.c rtc/rtc.c eeprom/eeprom.c \
+ *           crc/crc16.c
+ * Build (simulator):
+ *   gcc -DI2C_BACKEND_SIM -o tinyrtc tools/tinyrtc.c i2c/i2c.c \
+ *           i2c/sim/i2c_sim.c rtc/rtc.c eeprom/eeprom.c \
+ *           crc/crc16.c
+ *
+ * Created: 2016-05-09
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../common.h"
+#include "../i2c/i2c.h"
+#include "../rtc/rtc.h"
+#include "../eeprom/eeprom.h"
+
+static int usage(void)
+{
+        fprintf(stderr, "usage: tinyrtc <cmd>...\n"
+                        "  init                  start the RTC\n"
+                        "  time                  print RTC min:sec\n"
+                        "  read <addr> <len>     hex dump EEPROM data\n"
+                        "  write <addr> <text>   write text to EEPROM\n");
+        return 1;
+}
+
+int main(int argc, char *argv[])
+{
+        struct rtc_time_var rtc;
+        uint8_t buf[256];
+        uint16_t addr, len, i;
+        int arg;
+
+        if (argc < 2)
+                return usage();
+        i2c_init();
+
+        for (arg = 1; arg < argc; arg++) {
+                if (strcmp(argv[arg], "init") == 0) {
+                        rtc_init();
+                } else if (strcmp(argv[arg], "time") == 0) {
+                        rtc_get_time_var(&rtc);
+                        printf("%d%d:%d%d\n", rtc.min_10, rtc.min_1,
+                                                rtc.sec_10, rtc.sec_1);
+                } else if (strcmp(argv[arg], "read") == 0 && arg + 2 < argc) {
+                        addr = strtoul(argv[++arg], NULL, 0);
+                        len = strtoul(argv[++arg], NULL, 0);
+                        if (len > sizeof(buf) ||
+                                        eeprom_get_data(addr, buf, len) != 0) {
+                                fprintf(stderr, "read failed\n");
+                                return 1;
+                        }
+                        for (i = 0; i < len; i++)
+                                printf("%02x%c", buf[i],
+                                        (i % 16 == 15 || i == len - 1) ?
+                                                                '\n' : ' ');
+                } else if (strcmp(argv[arg], "write") == 0 && arg + 2 < argc) {
+                        addr = strtoul(argv[++arg], NULL, 0);
+                        arg++;
+                        if (eeprom_set_data(addr, (uint8_t *)argv[arg],
+                                                strlen(argv[arg])) != 0) {
+                                fprintf(stderr, "write failed\n");
+                                return 1;
+                        }
+                } else {
+                        return usage();
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * twi_replay.c
+ *
+ * Description: Host-side replayer for TWI bus traces captured with
+ * TWI_TRACE (i2c/twi/twi_trace.h). The "T <tick> <status> <data>" lines of
+ * a UART log are split into bus transfers (START/Sr to Sr/STOP), which are
+ * printed with their duration and replayed against the simulated bus. Read
+ * data that differs from the simulator is flagged, note that the simulator
+ * starts erased so reads of EEPROM data written before the capture, and
+ * RTC time registers, are expected to differ.
+ *
+ * With a second trace, e.g. captured with another firmware version running
+ * the same scenario, the transfer sequences are compared and the bus time
+ * of both is summarized.
+ *
+ * Timestamps are 16-bit Timer1 ticks (clock/clock.h), so only durations
+ * within a transfer are exact, idle gaps longer than 32 ms alias.
+ *
+ * Build:
+ *   gcc -o twi_replay tools/twi_replay.c i2c/sim/i2c_sim.c
+ * Usage:
+ *   twi_replay <trace> [<trace>]
+ *
+ * Created: 2016-05-23
+ * Author: alex.rodzevski@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../common.h"
+#include "../i2c/sim/i2c_sim.h"
+
+/* Timer1 pre-scaling, see clock/clock.h */
+#define CLOCK_PRESCALE          8
+/* Same as in i2c/twi/twi_trace.h */
+#define TWI_TRACE_STOP          0x01
+
+/* TWSR master status codes, as in avr-libc <util/twi.h> */
+#define TW_START                0x08
+#define TW_REP_START            0x10
+#define TW_MT_SLA_ACK           0x18
+#define TW_MT_SLA_NACK          0x20
+#define TW_MT_DATA_ACK          0x28
+#define TW_MT_DATA_NACK         0x30
+#define TW_MT_ARB_LOST          0x38
+#define TW_MR_SLA_ACK           0x40
+#define TW_MR_SLA_NACK          0x48
+#define TW_MR_DATA_ACK          0x50
+#define TW_MR_DATA_NACK         0x58
+#define TW_READ                 1
+
+#define XFER_MAX_LEN            256
+#define XFER_MAX                4096
+
+struct xfer {
+        uint8_t cli_addr;
+        uint8_t rd;
+        uint8_t nack;           /* Address or data NACK, lost arbitration */
+        uint8_t stop;           /* Ended with STOP rather than Sr */
+        uint16_t len;
+        uint8_t dat[XFER_MAX_LEN];
+        uint32_t ticks;
+};
+
+struct trace {
+        struct xfer *xfers;
+        int nbr_xfers;
+        uint32_t bus_ticks;
+        uint32_t wr_bytes, rd_bytes;
+        uint32_t nacks;
+        uint32_t mismatches;
+};
+
+static double ticks_to_us(uint32_t ticks)
+{
+        return ticks * (1e6 * CLOCK_PRESCALE / F_CPU);
+}
+
+static int trace_load(const char *path, struct trace *tr)
+{
+        char line[128];
+        unsigned int tick, status, data;
+        uint16_t prev = 0;
+        struct xfer *x = NULL;
+        FILE *f;
+
+        f = fopen(path, "r");
+        if (!f) {
+                perror(path);
+                return -1;
+        }
+        tr->xfers = calloc(XFER_MAX, sizeof(*tr->xfers));
+        if (!tr->xfers) {
+                fclose(f);
+                return -1;
+        }
+
+        while (fgets(line, sizeof(line), f)) {
+                if (sscanf(line, "T %x %x %x", &tick, &status, &data) != 3)
+                        continue;
+                if (x)
+                        x->ticks += (uint16_t)(tick - prev);
+                prev = tick;
+
+                switch (status) {
+                case TW_START:
+                case TW_REP_START:
+                        if (tr->nbr_xfers == XFER_MAX) {
+                                fprintf(stderr, "%s: too many transfers\n",
+                                                                path);
+                                fclose(f);
+                                return -1;
+                        }
+                        x = &tr->xfers[tr->nbr_xfers++];
+                        break;
+                case TWI_TRACE_STOP:
+                        if (x)
+                                x->stop = 1;
+                        x = NULL;
+                        break;
+                case TW_MT_SLA_ACK:
+                case TW_MT_SLA_NACK:
+                case TW_MR_SLA_ACK:
+                case TW_MR_SLA_NACK:
+                        if (!x)
+                                break;
+                        x->cli_addr = data >> 1;
+                        x->rd = data & TW_READ;
+                        if (status == TW_MT_SLA_NACK ||
+                            status == TW_MR_SLA_NACK)
+                                x->nack = 1;
+                        break;
+                case TW_MT_DATA_ACK:
+                case TW_MT_DATA_NACK:
+                case TW_MR_DATA_ACK:
+                case TW_MR_DATA_NACK:
+                        if (!x || x->len == XFER_MAX_LEN)
+                                break;
+                        x->dat[x->len++] = data;
+                        if (status == TW_MT_DATA_NACK)
+                                x->nack = 1;
+                        break;
+                case TW_MT_ARB_LOST:
+                        if (x)
+                                x->nack = 1;
+                        break;
+                default:
+                        /* Slave side and bus errors are not replayed */
+                        break;
+                }
+        }
+        fclose(f);
+        return 0;
+}
+
+static void trace_replay(struct trace *tr, int verbose)
+{
+        uint8_t sim[XFER_MAX_LEN];
+        struct xfer *x;
+        int i, j, differ;
+
+        i2c_sim_reset();
+        for (i = 0; i < tr->nbr_xfers; i++) {
+                x = &tr->xfers[i];
+                tr->bus_ticks += x->ticks;
+                differ = 0;
+                if (x->nack) {
+                        tr->nacks++;
+                } else if (x->rd) {
+                        tr->rd_bytes += x->len;
+                        i2c_sim_read(x->cli_addr, sim, x->len);
+                        differ = memcmp(sim, x->dat, x->len);
+                } else {
+                        tr->wr_bytes += x->len;
+                        i2c_sim_write(x->cli_addr, x->dat, x->len);
+                }
+                if (differ)
+                        tr->mismatches++;
+
+                if (!verbose)
+                        continue;
+                printf("%9.1fus %c 0x%02x%s [%d]", ticks_to_us(x->ticks),
+                                x->rd ? 'R' : 'W', x->cli_addr,
+                                x->nack ? " NACK" : "", x->len);
+                for (j = 0; j < x->len; j++)
+                        printf(" %02x", x->dat[j]);
+                printf("%s\n", x->stop ? " P" : "");
+                if (!differ)
+                        continue;
+                printf("%*s sim", 26, "");
+                for (j = 0; j < x->len; j++)
+                        printf(" %02x", sim[j]);
+                printf("\n");
+        }
+}
+
+static void trace_summary(const char *path, const struct trace *tr)
+{
+        printf("%s: %d transfers, %u bytes written, %u read, %u NACKs, "
+                        "%u read mismatches, bus time %.1fus\n", path,
+                        tr->nbr_xfers, tr->wr_bytes, tr->rd_bytes, tr->nacks,
+                        tr->mismatches, ticks_to_us(tr->bus_ticks));
+}
+
+static int xfer_cmp(const struct xfer *a, const struct xfer *b)
+{
+        return a->cli_addr != b->cli_addr || a->rd != b->rd ||
+                a->nack != b->nack || a->len != b->len ||
+                memcmp(a->dat, b->dat, a->len);
+}
+
+/* Transfer sequences are compared without the ACK polling NACKs, as the
+ * number of polls depends on the EEPROM write cycle time.
+ */
+static int trace_compare(const struct trace *a, const struct trace *b)
+{
+        int i = 0, j = 0;
+
+        while (i < a->nbr_xfers && j < b->nbr_xfers) {
+                if (a->xfers[i].nack && !a->xfers[i].len) {
+                        i++;
+                        continue;
+                }
+                if (b->xfers[j].nack && !b->xfers[j].len) {
+                        j++;
+                        continue;
+                }
+                if (xfer_cmp(&a->xfers[i], &b->xfers[j])) {
+                        printf("transfers differ at %d/%d\n", i, j);
+                        return -1;
+                }
+                i++;
+                j++;
+        }
+        if (i != a->nbr_xfers || j != b->nbr_xfers) {
+                printf("transfer count differs\n");
+                return -1;
+        }
+        printf("transfer sequences match\n");
+        return 0;
+}
+
+int main(int argc, char *argv[])
+{
+        struct trace tr[2];
+        int i;
+
+        if (argc < 2 || argc > 3) {
+                fprintf(stderr, "usage: twi_replay <trace> [<trace>]\n");
+                return 1;
+        }
+
+        memset(tr, 0, sizeof(tr));
+        for (i = 1; i < argc; i++) {
+                if (trace_load(argv[i], &tr[i - 1]))
+                        return 1;
+                trace_replay(&tr[i - 1], argc == 2);
+        }
+        for (i = 1; i < argc; i++)
+                trace_summary(argv[i], &tr[i - 1]);
+        if (argc == 3) {
+                printf("bus time delta %+.1fus\n",
+                                ticks_to_us(tr[1].bus_ticks) -
+                                ticks_to_us(tr[0].bus_ticks));
+                return trace_compare(&tr[0], &tr[1]) ? 2 : 0;
+        }
+        return tr[0].mismatches ? 2 : 0;
+}
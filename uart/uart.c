@@ -1,19 +1,39 @@
 /*
  * File name: uart.c
  * 
- * Description: A rudimentary UART driver for the ATMega 2560 chip
+ * Description: A rudimentary UART driver for the ATMega 2560 chip. Output
+ * goes through an interrupt driven TX ring buffer, writers only block when
+ * it is full. Input, once started, is queued by the RX ISR into a ring
+ * buffer, bytes are dropped when it is full.
  *
  * Created: 2016-04-05
  * Author: alex.rodzevski@gmail.com
  */ 
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <stdio.h>
 #include "../common.h"
+#include "../profile/profile.h"
+#include "../isr/ring.h"
 #include "uart.h"
 
 #define MYUBRR  (unsigned int)(F_CPU/16/BAUD-1)
 
+/* TX ring, written by uart0_transmit() and drained by the UDRE ISR */
+static uint8_t uart_tx_buf[UART_TX_LENGTH];
+static struct ring uart_tx;
+/* One-shot callback, run from the ISR once uart_tx_need bytes are free */
+static void (*volatile uart_tx_cb)(void);
+static uint8_t uart_tx_need;
+
+/* RX ring, written by the RX ISR and read by uart0_rx_get() */
+static uint8_t uart_rx_buf[UART_RX_LENGTH];
+static struct ring uart_rx;
+/* Run from the ISR when a byte arrives into the empty ring */
+static void (*volatile uart_rx_cb)(void);
+
 static int uart_putchar(char c, FILE *unused)
 {
         if (c == '\n')
@@ -26,6 +46,9 @@ FILE mystdout = FDEV_SETUP_STREAM(uart_putchar, NULL, _FDEV_SETUP_WRITE);
 
 void uart0_init(void)
 {
+        ring_init(&uart_tx);
+        uart_tx_cb = NULL;
+
         /* Set baud rate */
         UBRR0H = (unsigned char)(MYUBRR >> 8);
         UBRR0L = (unsigned char)MYUBRR;
@@ -38,11 +61,109 @@ void uart0_init(void)
         stdout = &mystdout;
 }
 
+/* Free bytes in the TX ring */
+uint8_t uart0_tx_free(void)
+{
+        return ring_free(&uart_tx, UART_TX_LENGTH);
+}
+
+/* Calls cb (in interrupt context) once at least need bytes of the TX ring
+ * are free, e.g. to resume a job that yielded on a full buffer.
+ */
+void uart0_tx_wait(uint8_t need, void (*cb)(void))
+{
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                uart_tx_need = need;
+                uart_tx_cb = cb;
+                UCSR0B |= (1 << UDRIE0);
+        }
+}
+
+/* Enables the RX interrupt, cb (interrupt context) is called whenever a byte
+ * arrives into the empty ring, i.e. once per burst read with
+ * uart0_rx_get() until it fails.
+ */
+void uart0_rx_start(void (*cb)(void))
+{
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                ring_init(&uart_rx);
+                uart_rx_cb = cb;
+                UCSR0B |= (1 << RXCIE0);
+        }
+}
+
+/* Next received byte, returns -1 if there is none */
+int uart0_rx_get(uint8_t *data)
+{
+        if (ring_empty(&uart_rx))
+                return -1;
+        *data = uart_rx_buf[ring_get_idx(&uart_rx)];
+        ring_get_commit(&uart_rx, UART_RX_LENGTH);
+        return 0;
+}
 
 void uart0_transmit(unsigned char data)
 {
-        /* Wait for empty transmit buffer */
-        while (!( UCSR0A & (1<<UDRE0)));
-        /* Start transmission by loading data into the buffer */
-        UDR0 = data;
-}
\ No newline at end of file
+        /* Wait for room in the ring. With interrupts disabled the ISR cannot
+         * drain it, send the oldest byte by polling instead, standing in
+         * for the ISR as the consumer.
+         */
+        while (ring_full(&uart_tx, UART_TX_LENGTH)) {
+                if (SREG & (1 << SREG_I))
+                        continue;
+                while (!( UCSR0A & (1<<UDRE0)));
+                UDR0 = uart_tx_buf[ring_get_idx(&uart_tx)];
+                ring_get_commit(&uart_tx, UART_TX_LENGTH);
+        }
+        uart_tx_buf[ring_put_idx(&uart_tx)] = data;
+        ring_put_commit(&uart_tx, UART_TX_LENGTH);
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                UCSR0B |= (1 << UDRIE0);
+        }
+}
+
+/*
+ * Interrupt Service Routine for the USART0 data register empty flag.
+ * Sends the next byte of the ring, or disables itself when it is empty.
+ */
+ISR(USART0_UDRE_vect)
+{
+        PROFILE_ENTER();
+        void (*cb)(void);
+
+        if (!ring_empty(&uart_tx)) {
+                UDR0 = uart_tx_buf[ring_get_idx(&uart_tx)];
+                ring_get_commit(&uart_tx, UART_TX_LENGTH);
+        } else {
+                UCSR0B &= ~(1 << UDRIE0);
+        }
+
+        cb = uart_tx_cb;
+        if (cb && uart0_tx_free() >= uart_tx_need) {
+                uart_tx_cb = NULL;
+                cb();
+        }
+        PROFILE_EXIT(PROFILE_UART);
+}
+
+/*
+ * Interrupt Service Routine for the USART0 receive complete flag.
+ * Queues the byte, the callback is run if the ring was empty.
+ */
+ISR(USART0_RX_vect)
+{
+        PROFILE_ENTER();
+        uint8_t data = UDR0;
+        uint8_t was_empty = ring_empty(&uart_rx);
+        void (*cb)(void);
+
+        if (!ring_full(&uart_rx, UART_RX_LENGTH)) {
+                uart_rx_buf[ring_put_idx(&uart_rx)] = data;
+                ring_put_commit(&uart_rx, UART_RX_LENGTH);
+                cb = uart_rx_cb;
+                if (cb && was_empty)
+                        cb();
+        }
+        PROFILE_EXIT(PROFILE_UART);
+}
@@ -10,7 +10,18 @@
 #ifndef UART_H_
 #define UART_H_
 
+#include <stdint.h>
+
+/* TX ring length, power of two, up to 256 */
+#define UART_TX_LENGTH          128
+/* RX ring length, power of two, up to 256 */
+#define UART_RX_LENGTH          32
+
 void uart0_init(void);
 void uart0_transmit(unsigned char data);
+uint8_t uart0_tx_free(void);
+void uart0_tx_wait(uint8_t need, void (*cb)(void));
+void uart0_rx_start(void (*cb)(void));
+int uart0_rx_get(uint8_t *data);
 
-#endif /* UART_H_ */
\ No newline at end of file
+#endif /* UART_H_ */